@@ -29,6 +29,24 @@
 
 #include <type_traits>
 #include <iostream>
+#include <tuple>
+#include <array>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <typeinfo>
+#include <utility>
+#include <cstdint>
+#include <new>
+#include <variant>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 template<typename DestT,typename SourceT,typename ArgT>
 inline DestT TTransition(SourceT&& s, ArgT arg)
@@ -89,16 +107,700 @@ struct DestArgT<T1,void>
   using ArgT = void;
 };
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Multi-hop transitions							   //
+//										   //
+// Edges of the graph are registered in a TGraph list, one TEdge per    	   //
+// TTransition specialisation:							   //
+//   using MyGraph = TGraph<TEdge<DestType,MyClass,ArgT>,...>;			   //
+// route<MyGraph,FinalType>(args...) finds the shortest chain of        	   //
+// transitions from the source type to FinalType (breadth first search) 	   //
+// and calls them in order, passing args to the hops that take an ArgT. 	   //
+//   FinalType z = x >> route<MyGraph,FinalType>(arg1,arg2);			   //
+// The graph is indexed once per Graph (node ids from sorted type keys,	   //
+// out-edges per node) and searched once per (Graph,Source) into a      	   //
+// predecessor table - all in constexpr arrays, not type lists. Every   	   //
+// destination only walks its predecessors back from that table.		   //
+/////////////////////////////////////////////////////////////////////////////////////
+
+template <typename... Ts>
+struct TList {};
+
+template <typename T>
+struct TTag {};
+
+template <typename... Ts>
+struct TSet : TTag<Ts>... {};
+
+template <typename SetT,typename T>
+constexpr bool t_contains = std::is_base_of<TTag<T>,SetT>::value;
+
+template <typename T>
+struct TIdentity { using type = T; };
+
+// t_at<TIndex<...>,I> - I-th type of a pack without recursion over the pack
+template <size_t I,typename T>
+struct TAt {};
+
+template <typename Seq,typename... Ts>
+struct TIndex;
+
+template <size_t... Is,typename... Ts>
+struct TIndex<std::index_sequence<Is...>,Ts...> : TAt<Is,Ts>... {};
+
+template <size_t I,typename T>
+TIdentity<T> t_at_fn(const TAt<I,T>*);
+
+// class template, so every lookup is deduced only once
+template <typename IndexT,size_t I>
+struct TAtOf { using type = typename decltype(t_at_fn<I>(static_cast<const IndexT*>(nullptr)))::type; };
+
+template <typename IndexT,size_t I>
+using t_at = typename TAtOf<IndexT,I>::type;
+
+// Compile-time type key: hash of the type name (GCC, Clang). Equal for
+// equal types. Distinct types with the same key (e.g. two lambdas of one
+// scope) are merged into one node by TGraphIndex without a check; only
+// transit() detects it, for the route it takes (TRoute::connected).
+// TRegistry does not use the keys.
+template <typename T>
+constexpr uint64_t t_key_fn()
+{
+  uint64_t result = 14695981039346656037u;
+  for(char c : std::string_view(__PRETTY_FUNCTION__))
+    result = (result ^ static_cast<unsigned char>(c)) * 1099511628211u;
+  return result;
+}
+
+template <typename T>
+constexpr uint64_t t_key = t_key_fn<T>();
+
+template <typename T1,typename T2,typename T3 = void>
+struct TEdge
+{
+  using DestT = T1;
+  using SourceT = T2;
+  using ArgT = T3;
+};
+
+template <typename... Edges>
+struct TGraph {};
+
+// Bottom-up merge sort of the first n elements. Plain arrays - std::array
+// is several times slower in the compiler's constant evaluation.
+template <typename T,size_t N>
+constexpr void t_sort(T (&a)[N],size_t n)
+{
+  T b[N] {};
+  T* from = a;
+  T* to = b;
+  for(size_t w = 1; w < n; w *= 2)
+    {
+      for(size_t lo = 0; lo < n; lo += 2*w)
+	{
+	  size_t mid = std::min(lo+w,n), hi = std::min(lo+2*w,n);
+	  size_t i = lo, j = mid, k = lo;
+	  while( i < mid && j < hi )
+	    to[k++] = from[j] < from[i] ? from[j++] : from[i++];
+	  while( i < mid ) to[k++] = from[i++];
+	  while( j < hi ) to[k++] = from[j++];
+	}
+      T* t = from; from = to; to = t;
+    }
+  if( from != a )
+    for(size_t i = 0; i < n; ++i)
+      a[i] = from[i];
+}
+
+template <typename Graph>
+struct TGraphIndex;
+
+template <typename... Edges>
+struct TGraphIndex<TGraph<Edges...>>
+{
+  static constexpr size_t edges = sizeof...(Edges);
+  using edge_list = TIndex<std::index_sequence_for<Edges...>,Edges...>;
+  // Plain arrays with one spare element, so an empty graph is valid too
+  struct Data
+  {
+    uint64_t keys[2*edges+1] {};	// node keys, sorted, [0,nodes)
+    size_t nodes = 0;
+    size_t source[edges+1] {};		// node id of edge source
+    size_t dest[edges+1] {};		// node id of edge destination
+    size_t first[2*edges+2] {};		// out-edges of node n are
+    size_t out[edges+1] {};		//   out[first[n]..first[n+1])
+    bool has_arg[edges+1] {};
+  };
+  // node id of key, nodes if not in the graph
+  static constexpr size_t find(const Data& d,uint64_t key)
+  {
+    size_t lo = 0, hi = d.nodes;
+    while( lo < hi )
+      {
+	size_t mid = (lo+hi)/2;
+	if( d.keys[mid] < key ) lo = mid+1;
+	else hi = mid;
+      }
+    return lo < d.nodes && d.keys[lo] == key ? lo : d.nodes;
+  }
+  static constexpr Data make()
+  {
+    Data d;
+    const uint64_t ends[] = { t_key<typename Edges::SourceT>...,
+			      t_key<typename Edges::DestT>..., 0 };
+    const bool has_arg[] = { !std::is_void<typename Edges::ArgT>::value..., false };
+    for(size_t i = 0; i < 2*edges; ++i)
+      d.keys[i] = ends[i];
+    t_sort(d.keys,2*edges);
+    for(size_t i = 0; i < 2*edges; ++i)
+      if( i == 0 || d.keys[i] != d.keys[d.nodes-1] )
+	d.keys[d.nodes++] = d.keys[i];
+    for(size_t i = 0; i < edges; ++i)
+      {
+	d.source[i] = find(d,ends[i]);
+	d.dest[i] = find(d,ends[edges+i]);
+	d.has_arg[i] = has_arg[i];
+	++d.first[d.source[i]+1];
+      }
+    for(size_t n = 0; n < d.nodes; ++n)
+      d.first[n+1] += d.first[n];
+    size_t fill[2*edges+2] {};
+    for(size_t n = 0; n < d.nodes; ++n)
+      fill[n] = d.first[n];
+    for(size_t i = 0; i < edges; ++i)
+      d.out[fill[d.source[i]]++] = i;
+    return d;
+  }
+  static constexpr Data data = make();
+  // node id of T, nodes if T is not in the graph
+  template <typename T>
+  static constexpr size_t id = find(data,t_key<T>);
+};
+
+// Breadth first search from SourceT: the edge each node was reached by
+template <typename Graph,typename SourceT>
+struct TRouteTree
+{
+  using index = TGraphIndex<Graph>;
+  static constexpr size_t none = index::edges;
+  struct Data
+  {
+    size_t pred[2*index::edges+1] {};
+    bool reached[2*index::edges+1] {};
+  };
+  static constexpr size_t source = index::template id<SourceT>;
+  static constexpr Data make()
+  {
+    const auto& g = index::data;
+    Data d;
+    for(auto& p : d.pred)
+      p = none;
+    if( source == g.nodes )
+      return d;
+    size_t queue[2*index::edges+1] {};
+    size_t head = 0, tail = 0;
+    d.reached[source] = true;
+    queue[tail++] = source;
+    while( head < tail )
+      {
+	size_t n = queue[head++];
+	for(size_t i = g.first[n]; i < g.first[n+1]; ++i)
+	  {
+	    size_t e = g.out[i];
+	    if( d.reached[g.dest[e]] )
+	      continue;
+	    d.reached[g.dest[e]] = true;
+	    d.pred[g.dest[e]] = e;
+	    queue[tail++] = g.dest[e];
+	  }
+      }
+    return d;
+  }
+  static constexpr Data data = make();
+};
+
+template <typename Graph,typename SourceT,typename DestT>
+struct TRoute
+{
+  using index = TGraphIndex<Graph>;
+  using tree = TRouteTree<Graph,SourceT>;
+  static constexpr size_t dest = index::template id<DestT>;
+  static constexpr bool found = std::is_same<SourceT,DestT>::value ||
+    (dest < index::data.nodes && tree::data.reached[dest]);
+  static_assert(found, "No TTransition route from SourceT to DestT");
+  static constexpr size_t count_hops()
+  {
+    size_t result = 0;
+    if( found && !std::is_same<SourceT,DestT>::value )
+      for(size_t n = dest; n != tree::source; n = index::data.source[tree::data.pred[n]])
+	++result;
+    return result;
+  }
+  static constexpr size_t hops = count_hops();
+  struct Path
+  {
+    size_t edge[hops+1] {};		// in call order
+    size_t arg[hops+1] {};		// route argument of hop i
+  };
+  static constexpr Path make_path()
+  {
+    Path p;
+    size_t n = dest;
+    for(size_t i = hops; i-- > 0; n = index::data.source[p.edge[i]])
+      p.edge[i] = tree::data.pred[n];
+    for(size_t i = 0; i < hops; ++i)
+      p.arg[i+1] = p.arg[i] + index::data.has_arg[p.edge[i]];
+    return p;
+  }
+  static constexpr Path path = make_path();
+  static constexpr size_t args = path.arg[hops];
+  template <size_t I>
+  using edge = t_at<typename index::edge_list,path.edge[I]>;
+
+  // Type the route is at before hop I
+  template <size_t I>
+  struct arrived { using type = typename edge<I-1>::DestT; };
+  template <size_t I>
+  using at_t = typename std::conditional_t<I == 0,TIdentity<SourceT>,arrived<I>>::type;
+  // Every hop leaves from the type the previous one arrived at. Fails only
+  // when distinct node types share a key (hash of the type name, e.g. two
+  // lambdas of one scope) and the search went through the merged node.
+  template <size_t... Is>
+  static constexpr bool connected(std::index_sequence<Is...>)
+  {
+    return (std::is_same<typename edge<Is>::SourceT,at_t<Is>>::value && ... &&
+	    std::is_same<at_t<hops>,DestT>::value);
+  }
+};
+
+// Single hop of a route as the DestArgT it would be written with by hand
+template<typename E,size_t J,typename ArgsT>
+inline
+auto
+thop ([[maybe_unused]] ArgsT& args)
+{
+  if constexpr (std::is_void<typename E::ArgT>::value)
+    return DestArgT<typename E::DestT>{};
+  else
+    {
+      typename E::ArgT arg = std::get<J>(args);
+      return DestArgT<typename E::DestT,typename E::ArgT>{arg};
+    }
+}
+
+// s >> hop0 >> hop1 >> ... - a flat chain, no recursion per hop
+template<typename RouteT,typename SourceT,typename ArgsT,size_t... Is>
+inline
+auto
+troute (SourceT&& s,[[maybe_unused]] ArgsT& args,std::index_sequence<Is...>)
+{
+  return (std::decay_t<SourceT>(static_cast<SourceT&&>(s)) >> ... >>
+	  thop<typename RouteT::template edge<Is>,RouteT::path.arg[Is]>(args));
+}
+
+template <typename Graph,typename T1,typename... ArgTs>
+struct RouteT
+{
+  using DestT = T1;
+  using ArgT = std::tuple<ArgTs...>;
+  ArgT value;
+};
+
+template <typename Graph,typename DestT,typename... ArgTs>
+inline
+RouteT<Graph,DestT,std::decay_t<ArgTs>...>
+route (ArgTs&&... args)
+{ return { std::tuple<std::decay_t<ArgTs>...>(std::forward<ArgTs>(args)...) }; }
+
+template<typename SourceT,typename Graph,typename DestT,typename... ArgTs>
+inline
+DestT
+transit (SourceT&& s,RouteT<Graph,DestT,ArgTs...> arg)
+{
+  using path = TRoute<Graph,std::decay_t<SourceT>,DestT>;
+  static_assert(!path::found || path::connected(std::make_index_sequence<path::hops>{}),
+		"Two distinct node types have the same key");
+  static_assert(!path::found || path::args == sizeof...(ArgTs),
+		"Number of route arguments does not match the route");
+  return troute<path>(static_cast<SourceT&&>(s),arg.value,
+		      std::make_index_sequence<path::hops>{});
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Runtime transitions								   //
+//										   //
+// TRegistry<MyGraph> dispatches the transitions registered in MyGraph  	   //
+// when the source type is known only at runtime. Every node gets a     	   //
+// dense id, TRegistry<MyGraph>::Value holds any node of the graph and  	   //
+// transitions are looked up in flat tables of function pointers:		   //
+//   TRegistry<MyGraph>::Value v = MyClass{};					   //
+//   TRegistry<MyGraph>::transit(v,TRegistry<MyGraph>::id<DestType>,arg);	   //
+//   DestType y = TRegistry<MyGraph>::convert<DestType>(v,arg);		   //
+// Both cost one indirect call and return false/throw if there is no    	   //
+// edge from the current type of the value.					   //
+/////////////////////////////////////////////////////////////////////////////////////
+
+template <typename ListT,typename... Ts>
+struct TUnique { using type = ListT; };
+
+template <typename... Us,typename T,typename... Ts>
+struct TUnique<TList<Us...>,T,Ts...>
+  : std::conditional_t<t_contains<TSet<Us...>,T>,
+		       TUnique<TList<Us...>,Ts...>,
+		       TUnique<TList<Us...,T>,Ts...>>
+{};
+
+template <typename T,typename... Ts>
+constexpr size_t t_index()
+{
+  constexpr bool same[] = { std::is_same<T,Ts>::value..., false };
+  size_t i = 0;
+  while( i < sizeof...(Ts) && !same[i] ) ++i;
+  return i;
+}
+
+template <typename NodesT>
+class TValue;
+
+template <typename... Ns>
+class TValue<TList<Ns...>>
+{
+  template <typename T>
+  static void destroy(void* p){ static_cast<T*>(p)->~T(); }
+  template <typename T>
+  static void move(void* dst,void* src){ new(dst) T(std::move(*static_cast<T*>(src))); }
+  static constexpr void (*destroy_fn[])(void*) = { &destroy<Ns>... };
+  static constexpr void (*move_fn[])(void*,void*) = { &move<Ns>... };
+public:
+  static constexpr size_t size = sizeof...(Ns);
+  static constexpr size_t npos = size;
+  template <typename T>
+  static constexpr size_t id = t_index<T,Ns...>();
+private:
+  alignas(Ns...) unsigned char data[std::max({sizeof(Ns)...})];
+  size_t type = npos;
+public:
+  TValue() = default;
+  template <typename T,std::enable_if_t<(id<std::decay_t<T>> < size),int> = 0>
+  TValue(T&& arg){ emplace<std::decay_t<T>>(std::forward<T>(arg)); }
+  TValue(TValue&& arg)
+  {
+    if( arg.type != npos )
+      move_fn[arg.type](data,arg.data);
+    type = arg.type;
+  }
+  TValue(const TValue&) = delete;
+  ~TValue(){ reset(); }
+
+  size_t index() const { return type; }
+  template <typename T>
+  T& get(){ return *std::launder(reinterpret_cast<T*>(data)); }
+  template <typename T,typename... Args>
+  T& emplace(Args&&... args)
+  {
+    reset();
+    T* result = new(data) T(std::forward<Args>(args)...);
+    type = id<T>;
+    return *result;
+  }
+  void reset()
+  {
+    if( type != npos )
+      destroy_fn[type](data);
+    type = npos;
+  }
+};
+
+template <typename ValueT,typename ResultT,typename ArgT>
+struct TConvFn { using type = ResultT (*)(ValueT&,ArgT); };
+
+template <typename ValueT,typename ResultT>
+struct TConvFn<ValueT,ResultT,void> { using type = ResultT (*)(ValueT&); };
+
+template <typename Graph>
+class TRegistry;
+
+template <typename... Edges>
+class TRegistry<TGraph<Edges...>>
+{
+public:
+  using Value = TValue<typename TUnique<TList<>,typename Edges::SourceT...,
+					typename Edges::DestT...>::type>;
+  static constexpr size_t size = Value::size;
+  template <typename T>
+  static constexpr size_t id = Value::template id<T>;
+private:
+  template <typename ResultT,typename ArgT>
+  using conv_fn = typename TConvFn<Value,ResultT,ArgT>::type;
+
+  template <typename E>
+  static typename E::DestT edge(Value& v)
+  { return TTransition<typename E::DestT>(std::move(v.template get<typename E::SourceT>())); }
+  template <typename E>
+  static typename E::DestT edge_arg(Value& v,typename E::ArgT arg)
+  { return TTransition<typename E::DestT>(std::move(v.template get<typename E::SourceT>()),arg); }
+  template <typename E>
+  static void edge_in_place(Value& v)
+  { v.template emplace<typename E::DestT>(edge<E>(v)); }
+  template <typename E>
+  static void edge_arg_in_place(Value& v,typename E::ArgT arg)
+  { v.template emplace<typename E::DestT>(edge_arg<E>(v,arg)); }
+
+  template <typename E,typename ArgT,typename DestT>
+  static constexpr conv_fn<DestT,ArgT> entry()
+  {
+    if constexpr (!std::is_same<typename E::ArgT,ArgT>::value ||
+		  !std::is_same<typename E::DestT,DestT>::value)
+      return nullptr;
+    else if constexpr (std::is_void<ArgT>::value)
+      return &edge<E>;
+    else
+      return &edge_arg<E>;
+  }
+  template <typename E,typename ArgT>
+  static constexpr conv_fn<void,ArgT> entry_in_place()
+  {
+    if constexpr (!std::is_same<typename E::ArgT,ArgT>::value)
+      return nullptr;
+    else if constexpr (std::is_void<ArgT>::value)
+      return &edge_in_place<E>;
+    else
+      return &edge_arg_in_place<E>;
+  }
+
+  // [source id * size + dest id] -> in place transition
+  template <typename ArgT>
+  static constexpr std::array<conv_fn<void,ArgT>,size*size> make_table()
+  {
+    std::array<conv_fn<void,ArgT>,size*size> result {};
+    const size_t pos[] = { id<typename Edges::SourceT>*size + id<typename Edges::DestT>... };
+    const conv_fn<void,ArgT> fns[] = { entry_in_place<Edges,ArgT>()... };
+    const bool used[] = { std::is_same<typename Edges::ArgT,ArgT>::value... };
+    for(size_t i = 0; i < sizeof...(Edges); ++i)
+      if( used[i] ) result[pos[i]] = fns[i];
+    return result;
+  }
+  // [source id] -> transition to DestT
+  template <typename DestT,typename ArgT>
+  static constexpr std::array<conv_fn<DestT,ArgT>,size> make_dest_table()
+  {
+    std::array<conv_fn<DestT,ArgT>,size> result {};
+    const size_t pos[] = { id<typename Edges::SourceT>... };
+    const conv_fn<DestT,ArgT> fns[] = { entry<Edges,ArgT,DestT>()... };
+    const bool used[] = { (std::is_same<typename Edges::ArgT,ArgT>::value &&
+			   std::is_same<typename Edges::DestT,DestT>::value)... };
+    for(size_t i = 0; i < sizeof...(Edges); ++i)
+      if( used[i] ) result[pos[i]] = fns[i];
+    return result;
+  }
+  template <typename ArgT>
+  static constexpr auto table = make_table<ArgT>();
+  template <typename DestT,typename ArgT>
+  static constexpr auto dest_table = make_dest_table<DestT,ArgT>();
+
+  // Edge whose declared ArgT an argument of type ArgT is passed as: the
+  // first one declaring exactly ArgT, else the first ArgT converts to.
+  // Only edges into DestT count, unless DestT is void.
+  template <typename ArgT,typename DestT>
+  static constexpr size_t arg_edge()
+  {
+    const bool to[] = { (std::is_void<DestT>::value ||
+			 std::is_same<typename Edges::DestT,DestT>::value)..., false };
+    const bool same[] = { std::is_same<typename Edges::ArgT,ArgT>::value..., false };
+    const bool conv[] = { (!std::is_void<typename Edges::ArgT>::value &&
+			   std::is_convertible<ArgT,typename Edges::ArgT>::value)..., false };
+    for(size_t i = 0; i < sizeof...(Edges); ++i)
+      if( to[i] && same[i] ) return i;
+    for(size_t i = 0; i < sizeof...(Edges); ++i)
+      if( to[i] && conv[i] ) return i;
+    return sizeof...(Edges);
+  }
+  template <typename ArgT,typename DestT = void>
+  struct TArgOf
+  {
+    static constexpr size_t edge = arg_edge<ArgT,DestT>();
+    static_assert(edge < sizeof...(Edges),"No edge takes this argument type");
+    using type = typename t_at<TIndex<std::index_sequence_for<Edges...>,Edges...>,
+			       edge < sizeof...(Edges) ? edge : 0>::ArgT;
+  };
+  template <typename ArgT,typename DestT = void>
+  using edge_arg_t = typename TArgOf<std::decay_t<ArgT>,DestT>::type;
+public:
+  static bool transit(Value& v,size_t dest)
+  {
+    if( v.index() >= size || dest >= size ) return false;
+    auto fn = table<void>[v.index()*size + dest];
+    if( !fn ) return false;
+    fn(v);
+    return true;
+  }
+  // arg is passed as the ArgT declared by the graph, e.g. char* as const char*
+  template <typename ArgT>
+  static bool transit(Value& v,size_t dest,ArgT arg)
+  {
+    if( v.index() >= size || dest >= size ) return false;
+    auto fn = table<edge_arg_t<ArgT>>[v.index()*size + dest];
+    if( !fn ) return false;
+    fn(v,arg);
+    return true;
+  }
+  template <typename DestT>
+  static DestT convert(Value& v)
+  {
+    auto fn = v.index() < size ? dest_table<DestT,void>[v.index()] : nullptr;
+    if( !fn ) throw std::bad_cast();
+    return fn(v);
+  }
+  template <typename DestT,typename ArgT>
+  static DestT convert(Value& v,ArgT arg)
+  {
+    auto fn = v.index() < size ? dest_table<DestT,edge_arg_t<ArgT,DestT>>[v.index()] : nullptr;
+    if( !fn ) throw std::bad_cast();
+    return fn(v,arg);
+  }
+};
+
+// Querry text is kept as a list of parts and glued together only when
+// needed - with one exact-size allocation. Keywords (static storage) are
+// kept as views, caller fragments are copied into a small inline buffer,
+// so a querry never refers to the caller's strings.
+class QuerryText
+{
+  static constexpr size_t max_parts = 8;
+  static constexpr size_t local_size = 64;
+  struct Part
+  {
+    const char* keyword;	// nullptr for a fragment copied to local
+    size_t offset;
+    size_t size;
+  };
+  std::string head;
+  std::array<Part,max_parts> parts;
+  size_t count = 0;
+  char local[local_size];
+  size_t used = 0;
+
+  std::string_view part(size_t i) const
+  {
+    const Part& p = parts[i];
+    return { p.keyword ? p.keyword : local + p.offset, p.size };
+  }
+public:
+  QuerryText() = default;
+  QuerryText(std::string arg):head(std::move(arg)){}
+  QuerryText(std::string_view arg){ *this += arg; }
+  QuerryText(const char* arg):QuerryText(std::string_view(arg)){}
+  // Fragment from the caller - copied
+  QuerryText& operator += (std::string_view arg)
+  {
+    if( count == max_parts || used + arg.size() > local_size )
+      flatten();
+    if( arg.size() > local_size )
+      {
+	head += arg;
+	return *this;
+      }
+    std::copy(arg.begin(),arg.end(),local + used);
+    parts[count++] = { nullptr, used, arg.size() };
+    used += arg.size();
+    return *this;
+  }
+  // Text with static storage duration - kept as a view
+  QuerryText& keyword(std::string_view arg)
+  {
+    if( count == max_parts )
+      flatten();
+    parts[count++] = { arg.data(), 0, arg.size() };
+    return *this;
+  }
+  // Glues the parts into one exact-size string
+  QuerryText& flatten()
+  {
+    head = str();
+    count = 0;
+    used = 0;
+    return *this;
+  }
+  size_t size() const
+  {
+    size_t result = head.size();
+    for(size_t i = 0; i < count; ++i)
+      result += parts[i].size;
+    return result;
+  }
+  void append_to(std::string& out) const
+  {
+    out += head;
+    for(size_t i = 0; i < count; ++i)
+      out += part(i);
+  }
+  std::string str() const
+  {
+    std::string result;
+    result.reserve(size());
+    append_to(result);
+    return result;
+  }
+  friend std::ostream& operator << (std::ostream& out,const QuerryText& arg)
+  {
+    out<<arg.head;
+    for(size_t i = 0; i < arg.count; ++i)
+      out<<arg.part(i);
+    return out;
+  }
+};
+
+// Compile-time querry text. fixed_querry() is not the transition chain:
+// it only glues the select/from/where keywords and literal fragments
+// together at compile time, for the common all-literal querry, and
+// send_querry() hands it to a sink with no copy or allocation.
+template <size_t N>
+struct FixedStr
+{
+  char data[N+1] {};
+  constexpr size_t size() const { return N; }
+  constexpr operator std::string_view() const { return {data,N}; }
+};
+
+template <size_t N>
+constexpr FixedStr<N-1> fixed(const char (&arg)[N])
+{
+  FixedStr<N-1> result;
+  for(size_t i = 0; i < N-1; ++i)
+    result.data[i] = arg[i];
+  return result;
+}
+
+template <size_t N,size_t M>
+constexpr FixedStr<N+M> operator + (const FixedStr<N>& a,const FixedStr<M>& b)
+{
+  FixedStr<N+M> result;
+  for(size_t i = 0; i < N; ++i)
+    result.data[i] = a.data[i];
+  for(size_t i = 0; i < M; ++i)
+    result.data[N+i] = b.data[i];
+  return result;
+}
+
+constexpr auto select_kw = fixed("select ");
+constexpr auto from_kw = fixed(" from ");
+constexpr auto where_kw = fixed(" where ");
+
+template <size_t S,size_t F,size_t W>
+constexpr auto fixed_querry(const char (&what)[S],const char (&from)[F],const char (&where)[W])
+{ return select_kw + fixed(what) + from_kw + fixed(from) + where_kw + fixed(where); }
+
 class Querry
 {
   template<typename DestT,typename SourceT,typename ArgT>
   friend  DestT TTransition(SourceT&& s, ArgT arg);
   template<typename DestT,typename SourceT>
   friend  DestT TTransition(SourceT&& s);
-  std::string str;
+  QuerryText str;
 public:
-  std::string getStr() const {return str;}
-  Querry(std::string arg):str(arg){}
+  std::string getStr() const {return str.str();}
+  const QuerryText& getText() const {return str;}
+  Querry(QuerryText arg):str(std::move(arg)){}
   Querry() = default;
   Querry(const Querry& arg) = default;
   Querry(Querry&& arg) = default;
@@ -108,12 +810,118 @@ struct QuerryStart : public Querry { using Querry::Querry; };
 struct Select : public Querry{ using Querry::Querry;};
 struct From : public Querry{ using Querry::Querry;};
 struct Where : public Querry{ using Querry::Querry;};
+// Sinks receive finished querries from Done::send.
+// ImmediateSink writes and flushes every querry on its own.
+struct ImmediateSink
+{
+  std::ostream& out;
+  void push(const QuerryText& arg){ out<<"sent: "<<arg<<std::endl; }
+  void push(std::string_view arg){ out<<"sent: "<<arg<<std::endl; }
+};
+
+// BatchedSink appends querries to a preallocated buffer and writes it out
+// once it would overflow or when max_delay passed since the last flush.
+// With background = true a flusher thread also flushes every max_delay,
+// so a quiet sink does not hold querries back.
+class BatchedSink
+{
+  using Clock = std::chrono::steady_clock;
+  std::ostream& out;
+  std::string buffer;
+  const size_t capacity;
+  const Clock::duration max_delay;
+  Clock::time_point last_flush = Clock::now();
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stop = false;
+  std::thread flusher;
+
+  void flush_locked()
+  {
+    if( !buffer.empty() )
+      {
+	out.write(buffer.data(),buffer.size());
+	out.flush();
+	buffer.clear();
+      }
+    last_flush = Clock::now();
+  }
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while( !stop )
+      if( !wake.wait_for(lock,max_delay,[this]{ return stop; }) )
+	flush_locked();
+  }
+public:
+  BatchedSink(std::ostream& arg,size_t capacity = 1<<16,
+	      Clock::duration max_delay = std::chrono::milliseconds(100),
+	      bool background = false)
+    :out(arg),capacity(capacity),max_delay(max_delay)
+  {
+    buffer.reserve(capacity);
+    if( background )
+      flusher = std::thread(&BatchedSink::run,this);
+  }
+  BatchedSink(const BatchedSink&) = delete;
+  BatchedSink& operator = (const BatchedSink&) = delete;
+  ~BatchedSink()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_one();
+    if( flusher.joinable() )
+      flusher.join();
+    flush();
+  }
+  void push(const QuerryText& arg){ push_text(arg); }
+  void push(std::string_view arg){ push_text(arg); }
+  void flush()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    flush_locked();
+  }
+private:
+  static void append(std::string& out,const QuerryText& arg){ arg.append_to(out); }
+  static void append(std::string& out,std::string_view arg){ out += arg; }
+  template <typename TextT>
+  void push_text(const TextT& arg)
+  {
+    constexpr std::string_view prefix = "sent: ";
+    size_t size = prefix.size() + arg.size() + 1;
+    std::lock_guard<std::mutex> lock(mutex);
+    if( buffer.size() + size > capacity )
+      flush_locked();
+    if( size > capacity )
+      {
+	out<<prefix<<arg<<'\n';
+	return;
+      }
+    buffer += prefix;
+    append(buffer,arg);
+    buffer += '\n';
+    if( Clock::now() - last_flush >= max_delay )
+      flush_locked();
+  }
+};
+
 struct Done : public Querry
 {
-  Done(std::string arg):Querry(arg){}
-  void send(){ std::cout<<"sent: "<<getStr()<<std::endl; }
+  // the finished querry owns its text in one buffer
+  Done(QuerryText arg):Querry(std::move(arg.flatten())){}
+  template <typename SinkT>
+  void send(SinkT& sink){ sink.push(getText()); }
+  void send(){ ImmediateSink sink {std::cout}; send(sink); }
 };
 
+// Querry text known in full, e.g. fixed_querry(): goes to the sink as it
+// is, without a QuerryText copy or any allocation
+template <typename SinkT>
+void send_querry(std::string_view text,SinkT& sink){ sink.push(text); }
+inline void send_querry(std::string_view text){ ImmediateSink sink {std::cout}; send_querry(text,sink); }
+
 using _Select = DestArgT<Select,const char*>;
 using _From = DestArgT<From,const char*>;
 using _Where = DestArgT<Where,const char*>;
@@ -124,7 +932,7 @@ using _Done = DestArgT<Done>;
 
 template<>
 inline Select TTransition<Select>(QuerryStart&& a,const char* what) {
-  (a.str += "select ") += what;
+  a.str.keyword(select_kw) += what;
   return std::move(a.str);
 }
 
@@ -135,7 +943,7 @@ inline Select TTransition<Select>(QuerryStart&& a,const char* what) {
 
 template<>
 inline From TTransition<From>(Select&& a,const char * what) {
-  (a.str += " from ") += what;
+  a.str.keyword(from_kw) += what;
   return std::move(a.str);
 }
 
@@ -146,7 +954,7 @@ inline From TTransition<From>(Select&& a,const char * what) {
 
 template<>
 inline Where TTransition<Where>(From&& a,const char* what){
-  (a.str += " where ") += what;
+  a.str.keyword(where_kw) += what;
   return std::move(a.str);
 }
 
@@ -156,8 +964,156 @@ inline Where TTransition<Where>(From&& a,const char* what){
 template<>
 inline Done TTransition<Done>(Where&& a) { return std::move(a.str); }
 
-int main()
+using QuerryGraph = TGraph<TEdge<Select,QuerryStart,const char*>,
+			   TEdge<From,Select,const char*>,
+			   TEdge<Where,From,const char*>,
+			   TEdge<Done,Where>>;
+
+// Runtime dispatch benchmark: source type chosen at runtime, converted to Kelvin
+struct Celsius { double value; };
+struct Fahrenheit { double value; };
+struct Kelvin { double value; };
+
+template<>
+inline Kelvin TTransition<Kelvin>(Celsius&& a) { return {a.value + 273.15}; }
+template<>
+inline Kelvin TTransition<Kelvin>(Fahrenheit&& a) { return {(a.value + 459.67)*5/9}; }
+template<>
+inline Kelvin TTransition<Kelvin>(Kelvin&& a) { return a; }
+
+using TempGraph = TGraph<TEdge<Kelvin,Celsius>,
+			 TEdge<Kelvin,Fahrenheit>,
+			 TEdge<Kelvin,Kelvin>>;
+using TempRegistry = TRegistry<TempGraph>;
+using TempVariant = std::variant<Celsius,Fahrenheit,Kelvin>;
+
+struct VTemp
 {
+  virtual ~VTemp() = default;
+  virtual Kelvin kelvin() = 0;
+};
+
+template <typename T>
+struct VTempT : public VTemp
+{
+  T temp;
+  VTempT(T arg):temp(arg){}
+  Kelvin kelvin() override { return TTransition<Kelvin>(T(temp)); }
+};
+
+template <typename F>
+double bench_ns(F f,size_t count)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double,std::nano>(stop-start).count()/count;
+}
+
+int bench()
+{
+  constexpr size_t count = 1<<20;
+  constexpr size_t rounds = 20;
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> pick(0,2);
+
+  std::vector<TempRegistry::Value> regs;
+  std::vector<std::unique_ptr<VTemp>> virts;
+  std::vector<TempVariant> vars;
+  regs.reserve(count);
+  virts.reserve(count);
+  vars.reserve(count);
+  for(size_t i = 0; i < count; ++i)
+    {
+      double x = i%100;
+      switch( pick(gen) )
+	{
+	case 0:
+	  regs.emplace_back(Celsius{x});
+	  virts.emplace_back(new VTempT<Celsius>({x}));
+	  vars.emplace_back(Celsius{x});
+	  break;
+	case 1:
+	  regs.emplace_back(Fahrenheit{x});
+	  virts.emplace_back(new VTempT<Fahrenheit>({x}));
+	  vars.emplace_back(Fahrenheit{x});
+	  break;
+	default:
+	  regs.emplace_back(Kelvin{x});
+	  virts.emplace_back(new VTempT<Kelvin>({x}));
+	  vars.emplace_back(Kelvin{x});
+	}
+    }
+
+  double sum[3] = {};
+  double registry_ns = bench_ns([&](){
+				  for(size_t r = 0; r < rounds; ++r)
+				    for(auto& v : regs)
+				      sum[0] += TempRegistry::convert<Kelvin>(v).value;
+				},count*rounds);
+  double virtual_ns = bench_ns([&](){
+				 for(size_t r = 0; r < rounds; ++r)
+				   for(auto& v : virts)
+				     sum[1] += v->kelvin().value;
+			       },count*rounds);
+  double variant_ns = bench_ns([&](){
+				 for(size_t r = 0; r < rounds; ++r)
+				   for(auto& v : vars)
+				     sum[2] += std::visit([](auto& t){
+							    return TTransition<Kelvin>(std::move(t));
+							  },v).value;
+			       },count*rounds);
+  std::cout<<"registry: "<<registry_ns<<" ns/op ("<<sum[0]<<")\n";
+  std::cout<<"virtual:  "<<virtual_ns<<" ns/op ("<<sum[1]<<")\n";
+  std::cout<<"variant:  "<<variant_ns<<" ns/op ("<<sum[2]<<")"<<std::endl;
+
+  // Querry sinks: every querry flushed on its own against batched writes
+  constexpr size_t querries = 1<<16;
+  std::ofstream null_out("/dev/null");
+  auto send_all = [&](auto& sink){
+		    for(size_t i = 0; i < querries; ++i)
+		      (QuerryStart{} >> _Select {"*"} >> _From {"table"}
+		       >> _Where {"id = 1"} >> _Done {}).send(sink);
+		  };
+  double immediate_ns = bench_ns([&](){
+				   ImmediateSink sink {null_out};
+				   send_all(sink);
+				 },querries);
+  double batched_ns = bench_ns([&](){
+				 BatchedSink sink {null_out};
+				 send_all(sink);
+			       },querries);
+  static constexpr auto fixed_q = fixed_querry("*","table","id = 1");
+  double fixed_ns = bench_ns([&](){
+			       BatchedSink sink {null_out};
+			       for(size_t i = 0; i < querries; ++i)
+				 send_querry(fixed_q,sink);
+			     },querries);
+  std::cout<<"immediate sink: "<<immediate_ns<<" ns/querry\n";
+  std::cout<<"batched sink:   "<<batched_ns<<" ns/querry\n";
+  std::cout<<"batched fixed:  "<<fixed_ns<<" ns/querry"<<std::endl;
+  return 0;
+}
+
+int main(int argc,const char* argv[])
+{
+  if( argc == 2 && std::string(argv[1]) == "bench" )
+    return bench();
+
   QuerryStart q;
   (q >> _Select {"*"} >> _From {"table"}  >> _Where {"id = 1"}  >> _Done {}).send();
+  (QuerryStart{} >> route<QuerryGraph,Done>("*","table","id = 2")).send();
+  static constexpr auto fixed_q = fixed_querry("*","table","id = 3");
+  send_querry(fixed_q);
+
+  using QuerryRegistry = TRegistry<QuerryGraph>;
+  QuerryRegistry::Value v = QuerryStart{};
+  QuerryRegistry::transit(v,QuerryRegistry::id<Select>,"*");
+  QuerryRegistry::transit(v,QuerryRegistry::id<From>,"table");
+  QuerryRegistry::transit(v,QuerryRegistry::id<Where>,"id = 4");
+  QuerryRegistry::convert<Done>(v).send();
+
+  BatchedSink sink {std::cout,1<<12,std::chrono::milliseconds(10),true};
+  (QuerryStart{} >> _Select {"*"} >> _From {"table"} >> _Where {"id = 5"} >> _Done {}).send(sink);
+  (QuerryStart{} >> route<QuerryGraph,Done>("*","table","id = 6")).send(sink);
 }
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# Codegen regression check and toggle rate benchmark of pins.cpp.
+#
+# The hot functions of Pin/PinSet are compiled to assembly and their
+# instructions and memory accessing instructions are counted. A count above
+# the budget below fails the check (exit status 1), so an extra load or
+# store does not slip in with a change or a compiler upgrade. Budgets are
+# for x86-64; on other targets the counts are only reported.
+# Then a driver toggles every variant in a loop and reports the rate.
+#
+# Usage: pins_codegen.py [--no-rate]
+# Environment: CXX (default g++), CXXFLAGS (default -std=c++17 -O2),
+#              ITERATIONS per toggle rate measurement (default 100000000)
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CXX = os.environ.get("CXX", "g++")
+CXXFLAGS = os.environ.get("CXXFLAGS", "-std=c++17 -O2").split()
+ITERATIONS = int(os.environ.get("ITERATIONS", "100000000"))
+
+# name: (statement, max instructions, max memory accessing instructions)
+# instruction counts include the final ret
+HOT = {
+    "pin_set": ("Pin<0,3>::set();", 2, 1),
+    "pin_reset": ("Pin<0,3>::reset();", 2, 1),
+    "pin_toggle": ("Pin<0,3>::toggle();", 2, 1),
+    "port_set": ("PortC::set();", 2, 1),
+    "port_reset": ("PortC::reset();", 2, 1),
+    "bus_set": ("Bus::set();", 4, 3),
+    "bus_toggle": ("Bus::toggle();", 4, 3),
+    "bus_atomic_toggle": ("Bus::atomic_toggle();", 3, 1),
+    "mapped_set": ("MappedBus::set();", 5, 2),
+    "mapped_toggle": ("MappedBus::toggle();", 5, 2),
+    "blink_port": ("blink<PortC,2>();", None, None),
+}
+
+HEADER = """#define main concept_main
+#include "%s"
+#undef main
+using PortC = PinSet<Pin<0,0>,Pin<0,1>,Pin<0,2>,Pin<0,3>,Pin<0,4>,Pin<0,5>,Pin<0,6>,Pin<0,7>>;
+using Bus = PinSet<Pin<0,1>,Pin<2,4>,Pin<5,7>,Pin<2,5>>;
+using Mapped = MappedPorts<0x600000000000>;
+using MappedBus = PinSet<Pin<0,0,Mapped>,Pin<0,1,Mapped>>;
+""" % os.path.join(ROOT, "pins.cpp")
+
+
+def hot_unit():
+    src = HEADER
+    for name, (stmt, _, _) in HOT.items():
+        src += 'extern "C" void %s() { %s }\n' % (name, stmt)
+    return src
+
+
+def rate_unit():
+    src = HEADER + "#include <cstdio>\nint main()\n{\n"
+    for name, (stmt, _, _) in HOT.items():
+        if name.startswith("mapped") or name.startswith("blink"):
+            continue
+        src += """  {
+    auto start = chrono::steady_clock::now();
+    for(long i = 0; i < %dL; ++i)
+      {
+        %s
+        asm volatile("" ::: "memory");
+      }
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%s %%.1f Mops/s\\n", %d / s / 1e6);
+  }
+""" % (ITERATIONS, stmt, name, ITERATIONS)
+    # blink sleeps, so its rate is compared with the nominal 500 Hz
+    src += """  {
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < 500; ++i)
+      blink<PortC,2>();
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("blink_port %.1f Hz (nominal 500 Hz, drift %.1f ms/s)\\n", 500 / s, (s - 1) * 1e3);
+  }
+"""
+    return src + "}\n"
+
+
+def functions(asm):
+    result = {}
+    current = None
+    for line in asm.split("\n"):
+        label = re.match(r"^([A-Za-z_][\w.]*):", line)
+        if label:
+            current = label.group(1) if label.group(1) in HOT else None
+            if current:
+                result[current] = []
+        elif current and line.startswith("\t") and not line.startswith("\t."):
+            result[current].append(line.strip())
+            if line.strip().startswith("ret"):
+                current = None
+    return result
+
+
+def memory_access(instruction):
+    op = instruction.split()[0]
+    return "(" in instruction and not op.startswith("lea") and not op.startswith("nop")
+
+
+def main():
+    machine = subprocess.run([CXX, "-dumpmachine"], capture_output=True,
+                             text=True).stdout
+    enforce = machine.startswith("x86_64")
+    failed = False
+    with tempfile.TemporaryDirectory() as workdir:
+        cpp = os.path.join(workdir, "hot.cpp")
+        with open(cpp, "w") as f:
+            f.write(hot_unit())
+        asm = subprocess.run([CXX] + CXXFLAGS + ["-S", "-o", "-", cpp],
+                             capture_output=True, text=True, check=True).stdout
+        print("function instructions memory budget status")
+        found = functions(asm)
+        for name in HOT.keys() - found.keys():
+            print(name, "missing from the assembly")
+            failed = True
+        for name, body in found.items():
+            _, max_insns, max_mem = HOT[name]
+            mem = sum(memory_access(i) for i in body)
+            status = "-"
+            if enforce and max_insns is not None:
+                ok = len(body) <= max_insns and mem <= max_mem
+                status = "ok" if ok else "REGRESSION"
+                failed |= not ok
+            print(name, len(body), mem,
+                  "-" if max_insns is None else "%d/%d" % (max_insns, max_mem),
+                  status)
+            if status == "REGRESSION":
+                print("  " + "\n  ".join(body))
+
+        if "--no-rate" not in sys.argv:
+            cpp = os.path.join(workdir, "rate.cpp")
+            exe = os.path.join(workdir, "rate")
+            with open(cpp, "w") as f:
+                f.write(rate_unit())
+            subprocess.run([CXX] + CXXFLAGS + [cpp, "-o", exe], check=True)
+            sys.stdout.flush()
+            subprocess.run([exe], check=True)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
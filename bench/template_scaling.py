@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+# Template instantiation scaling of the metaprogramming concepts.
+#
+# For every component and N, a translation unit is generated that includes
+# the concept source (its main() renamed) and instantiates the component
+# with N nodes/mixins/pins - once through the recursive template and once
+# through its flat counterpart (PinSet also through its mask version). Each unit is compiled separately and the
+# compile time, peak compiler memory and code size are reported. Code size
+# is taken from the symbol table (nm --size-sort): the size of run() and
+# the total size of the symbols the unit defines beyond a unit that only
+# includes the concept source - i.e. what the component instantiated.
+#
+# Usage: template_scaling.py [N...]      (default: 10 100 1000)
+# Environment: CXX (default g++), CXXFLAGS (default -std=c++17 -O2),
+#              TIMEOUT per compilation in seconds (default 600)
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CXX = os.environ.get("CXX", "g++")
+CXXFLAGS = os.environ.get("CXXFLAGS", "-std=c++17 -O2").split()
+TIMEOUT = float(os.environ.get("TIMEOUT", "600"))
+
+
+def include(name):
+    return ("#define main concept_main\n"
+            "#include \"%s\"\n"
+            "#undef main\n" % os.path.join(ROOT, name))
+
+
+# TemplateTypeGraph: chain of N node types N0 -> N1 -> ... -> N(n-1)
+# recursive - compile-time route search through the whole chain
+# flat      - the same chain spelled as explicit single hops
+def type_graph(n, variant):
+    src = include("TemplateTypeGraph.cpp")
+    for i in range(n):
+        src += "struct N%d { int v; };\n" % i
+    for i in range(1, n):
+        src += ("template<> inline N%d TTransition<N%d>(N%d&& a)"
+                " { return {a.v+1}; }\n" % (i, i, i - 1))
+    src += "using ChainGraph = TGraph<%s>;\n" % ",".join(
+        "TEdge<N%d,N%d>" % (i, i - 1) for i in range(1, n))
+    if variant == "flat":
+        hops = "".join(" >> DestArgT<N%d>{}" % i for i in range(1, n))
+        src += "int run(int x) { return (N0{x}%s).v; }\n" % hops
+    else:
+        src += ("int run(int x) { return (N0{x} >> route<ChainGraph,N%d>()).v; }\n"
+                % (n - 1))
+    return src
+
+
+# Pikotaro: composite of N distinct mixins
+# recursive - Pikotaro (Pikotaro2 inheritance chain)
+# flat      - PikotaroFlat (pack expanded bases)
+def pikotaro(n, variant):
+    src = include("pikotaro.cpp")
+    for i in range(n):
+        src += ("template <class X> struct M%d { int m%d = %d;"
+                " int get%d() { return m%d; } };\n" % (i, i, i, i, i))
+    src += "using Composite = %s<nullClass,%s>;\n" % (
+        "PikotaroFlat" if variant == "flat" else "Pikotaro",
+        ",".join("M%d" % i for i in range(n)))
+    src += "int run(Composite& c) { return %s; }\n" % "+".join(
+        "c.get%d()" % i for i in range(n))
+    return src
+
+
+# PinSet: set/reset of N pins spread over all output bytes
+# recursive - PinSetRecursive (the former PinSet: one instantiation per pin)
+# masks     - PinSet (per-port masks built from the pin pack at compile time)
+# flat      - PinSetFlat (fold expression, one write per pin)
+PINSET_RECURSIVE = """
+template < typename PIN, typename... REST>
+struct PinSetRecursive
+{
+    static void set(){ PIN::set(); PinSetRecursive<REST...>::set(); }
+    static void reset(){ PIN::reset(); PinSetRecursive<REST...>::reset(); }
+};
+template <typename PIN>
+struct PinSetRecursive<PIN>
+{
+    static void set(){ PIN::set(); }
+    static void reset(){ PIN::reset(); }
+};
+"""
+
+
+def pinset(n, variant):
+    src = include("pins.cpp") + PINSET_RECURSIVE
+    src += "using Pins = %s<%s>;\n" % (
+        {"recursive": "PinSetRecursive", "masks": "PinSet",
+         "flat": "PinSetFlat"}[variant],
+        ",".join("Pin<%d,%d>" % ((i // 8) % 16, i % 8) for i in range(n)))
+    src += "void run() { Pins::set(); Pins::reset(); }\n"
+    return src
+
+
+COMPONENTS = [("TemplateTypeGraph", type_graph, "TemplateTypeGraph.cpp",
+               ("recursive", "flat")),
+              ("Pikotaro", pikotaro, "pikotaro.cpp", ("recursive", "flat")),
+              ("PinSet", pinset, "pins.cpp", ("recursive", "masks", "flat"))]
+
+
+# {mangled symbol: size} of the defined symbols with a size - not
+# demangled, the demangler gives up on the longest instantiations
+def symbols(obj):
+    out = subprocess.run(["nm", "-S", "--size-sort", "--defined-only",
+                          obj], capture_output=True, text=True)
+    result = {}
+    for line in out.stdout.split("\n"):
+        fields = line.split(None, 3)
+        if len(fields) == 4:
+            result[fields[3]] = int(fields[1], 16)
+    return result
+
+
+# "run/instantiated" bytes: run() and the symbols not in the baseline unit
+def code_size(obj, baseline):
+    syms = symbols(obj)
+    run = sum(size for name, size in syms.items() if name.startswith("_Z3run"))
+    added = sum(size for name, size in syms.items() if name not in baseline)
+    return "%d/%d" % (run, added)
+
+
+def compile_unit(src, workdir, n, baseline=None):
+    cpp = os.path.join(workdir, "unit.cpp")
+    obj = os.path.join(workdir, "unit.o")
+    with open(cpp, "w") as f:
+        f.write(src)
+    if os.path.exists(obj):
+        os.remove(obj)
+    cmd = [CXX] + CXXFLAGS + ["-ftemplate-depth=%d" % (4 * n + 1000),
+                              "-c", cpp, "-o", obj]
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid:
+            break
+        if time.monotonic() - start > TIMEOUT:
+            proc.kill()
+            os.wait4(proc.pid, 0)
+            return "timeout", "-", "-", "-"
+        time.sleep(0.01)
+    seconds = "%.2f" % (time.monotonic() - start)
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        return "error", seconds, "-", "-"
+    # ru_maxrss of the driver includes the compiler processes it waited for
+    if baseline is None:
+        return symbols(obj)
+    return "ok", seconds, str(usage.ru_maxrss), code_size(obj, baseline)
+
+
+def main():
+    sizes = [int(a) for a in sys.argv[1:]] or [10, 100, 1000]
+    print("component variant N status seconds peak_kB run/instantiated_bytes")
+    with tempfile.TemporaryDirectory() as workdir:
+        for name, generate, source, variants in COMPONENTS:
+            baseline = compile_unit(include(source), workdir, 0)
+            if not isinstance(baseline, dict):
+                print(name, "baseline", *baseline, flush=True)
+                continue
+            for n in sizes:
+                for variant in variants:
+                    result = compile_unit(generate(n, variant), workdir, n,
+                                          baseline)
+                    print(name, variant, n, *result, flush=True)
+
+
+if __name__ == "__main__":
+    main()
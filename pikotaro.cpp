@@ -1,17 +1,74 @@
 #include <iostream>
 #include <utility>
+#include <type_traits>
+#include <tuple>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <memory>
+#include <functional>
 using namespace std;
 
+// Arguments of one mixin constructor, passed as a single Pikotaro argument:
+// Pikotaro<X,Pen,Apple>(mixin_args(a,b),c) builds Pen from (a,b) in place.
+template <typename... Args>
+struct MixinArgs { tuple<Args&&...> args; };
+template <typename... Args>
+MixinArgs<Args...> mixin_args(Args&&... args){ return {forward_as_tuple(forward<Args>(args)...)}; }
+
+// True when a single argument is the composite itself - copy/move is left
+// to the implicit constructors instead of the forwarding ones.
+template <typename Self,typename... Args>
+constexpr bool pikotaro_self = false;
+template <typename Self,typename Arg>
+constexpr bool pikotaro_self<Self,Arg> = is_base_of<Self,decay_t<Arg>>::value;
+
+template <typename T>
+constexpr bool pikotaro_mixin_args = false;
+template <typename... Args>
+constexpr bool pikotaro_mixin_args<MixinArgs<Args...>> = true;
+
+// Stands for a missing argument: the mixin is default constructed
+struct PikotaroNone {};
+
+// Base holding one mixin of a flat composite, built in place from its
+// argument - a single value, mixin_args(...) or PikotaroNone - so the
+// mixin is never moved and need not be movable.
+template <typename Mixin>
+struct PikotaroSlot : public Mixin
+{
+    PikotaroSlot(PikotaroNone):Mixin(){}
+    template<typename Arg,
+	     typename = enable_if_t<!pikotaro_mixin_args<decay_t<Arg>> &&
+				    !is_same<decay_t<Arg>,PikotaroNone>::value &&
+				    !pikotaro_self<PikotaroSlot,Arg>>>
+    PikotaroSlot(Arg&& arg):Mixin(forward<Arg>(arg)){}
+    template<typename... Ts>
+    PikotaroSlot(MixinArgs<Ts...> arg):PikotaroSlot(arg.args,index_sequence_for<Ts...>{}){}
+    template<typename Tuple,size_t... Is>
+    PikotaroSlot(Tuple& args,index_sequence<Is...>):Mixin(get<Is>(move(args))...){}
+};
+
+// Arguments are forwarded down the recursion and each mixin is constructed
+// in place from its own one, so nothing is copied on the way.
 template <typename Pikotaro_Base,
 	  template <class X> typename Type1,
 	  template <class X> typename... Types
 	  >
 struct Pikotaro2 : public Type1<Pikotaro_Base>,public Pikotaro2<Pikotaro_Base,Types...>
 {
-    template<typename Arg1>
-    Pikotaro2(Arg1 arg1):Type1<Pikotaro_Base>(arg1){}
-    template<typename Arg1,typename...Args>
-    Pikotaro2(Arg1 arg1,Args... args):Type1<Pikotaro_Base>(arg1),Pikotaro2<Pikotaro_Base,Types...>(args...){}
+    template<typename Arg1,typename...Args,
+	     typename = enable_if_t<!pikotaro_self<Pikotaro2,Arg1>>>
+    Pikotaro2(Arg1&& arg1,Args&&... args)
+	:Type1<Pikotaro_Base>(forward<Arg1>(arg1)),
+	 Pikotaro2<Pikotaro_Base,Types...>(forward<Args>(args)...){}
+    template<typename... Ts,typename...Args>
+    Pikotaro2(MixinArgs<Ts...> arg1,Args&&... args)
+	:Pikotaro2(arg1.args,index_sequence_for<Ts...>{},forward<Args>(args)...){}
+    template<typename Tuple,size_t... Is,typename...Args>
+    Pikotaro2(Tuple& arg1,index_sequence<Is...>,Args&&... args)
+	:Type1<Pikotaro_Base>(get<Is>(move(arg1))...),
+	 Pikotaro2<Pikotaro_Base,Types...>(forward<Args>(args)...){}
     Pikotaro2(){}
 };
 
@@ -20,22 +77,294 @@ template <typename Pikotaro_Base,
 	  >
 struct Pikotaro2<Pikotaro_Base,Type1> : public Type1<Pikotaro_Base>
 {
-    template<typename Arg1>
-    Pikotaro2(Arg1 arg1):Type1<Pikotaro_Base>(arg1){}
+    template<typename Arg1,
+	     typename = enable_if_t<!pikotaro_self<Pikotaro2,Arg1>>>
+    Pikotaro2(Arg1&& arg1):Type1<Pikotaro_Base>(forward<Arg1>(arg1)){}
+    template<typename... Ts>
+    Pikotaro2(MixinArgs<Ts...> arg1):Pikotaro2(arg1.args,index_sequence_for<Ts...>{}){}
+    template<typename Tuple,size_t... Is>
+    Pikotaro2(Tuple& arg1,index_sequence<Is...>):Type1<Pikotaro_Base>(get<Is>(move(arg1))...){}
     Pikotaro2(){}
 };
 class nullClass{};
+// Broadcast: f is called on every mixin it can be called on, in mixin order.
+// Which mixins take part is decided at compile time, calls are direct.
+// PIKOTARO_CALL(draw) makes f calling draw() on mixins that have it.
+#define PIKOTARO_CALL(method)						\
+    [](auto& mixin,auto&&... args)					\
+	-> decltype(mixin.method(forward<decltype(args)>(args)...))	\
+    { return mixin.method(forward<decltype(args)>(args)...); }
+
 template <class Y=nullClass,template <class X> typename... Types>
 struct Pikotaro : public Pikotaro2<Pikotaro<Y,Types...>,Types...>//public Types<Pikotaro<Types...>>...
 {
-    template<typename... Args>
-    Pikotaro(Args... args):Pikotaro2<Pikotaro<Y,Types...>,Types...>(args...){}
+    template<typename... Args,
+	     typename = enable_if_t<!pikotaro_self<Pikotaro,Args...>>>
+    Pikotaro(Args&&... args):Pikotaro2<Pikotaro<Y,Types...>,Types...>(forward<Args>(args)...){}
+
+    template <typename F,typename... Args>
+    static constexpr size_t providers = (size_t(0) + ... +
+					 is_invocable<F&,Types<Pikotaro>&,Args&...>::value);
+
+    template <typename F,typename... Args>
+    void broadcast(F f,Args&&... args)
+    {
+	static_assert(providers<F,Args...> > 0,"No mixin provides the broadcasted call");
+	(call_if(static_cast<Types<Pikotaro>&>(*this),f,args...), ...);
+    }
+    // Folds results of the providing mixins: init = op(init,f(mixin,args...))
+    template <typename F,typename Op,typename T,typename... Args>
+    T fold(F f,Op op,T init,Args&&... args)
+    {
+	static_assert(providers<F,Args...> > 0,"No mixin provides the folded call");
+	((init = fold_if(static_cast<Types<Pikotaro>&>(*this),f,op,move(init),args...)), ...);
+	return init;
+    }
+private:
+    template <typename M,typename F,typename... Args>
+    static void call_if(M& mixin,F& f,Args&... args)
+    {
+	if constexpr (is_invocable<F&,M&,Args&...>::value)
+	    f(mixin,args...);
+    }
+    template <typename M,typename F,typename Op,typename T,typename... Args>
+    static T fold_if(M& mixin,F& f,Op& op,T&& init,Args&... args)
+    {
+	if constexpr (is_invocable<F&,M&,Args&...>::value)
+	    return op(move(init),f(mixin,args...));
+	else
+	    return move(init);
+    }
+};
+
+// Flat version - every mixin is a base of its own slot, no Pikotaro2
+// recursion. Takes one constructor argument per mixin or none at all.
+template <class Y=nullClass,template <class X> typename... Types>
+struct PikotaroFlat : public PikotaroSlot<Types<PikotaroFlat<Y,Types...>>>...
+{
+    PikotaroFlat():PikotaroSlot<Types<PikotaroFlat<Y,Types...>>>(PikotaroNone{})...{}
+    template<typename... Args,
+	     typename = enable_if_t<sizeof...(Args) == sizeof...(Types) &&
+				    !pikotaro_self<PikotaroFlat,Args...>>>
+    PikotaroFlat(Args&&... args):PikotaroSlot<Types<PikotaroFlat<Y,Types...>>>(forward<Args>(args))...{}
+};
+
+// Packed version - flat like PikotaroFlat, but bases are ordered by
+// alignment (empty mixins first, then the strictest alignment) so that
+// mixins do not leave padding between each other. Constructor arguments
+// still go to mixins in declaration order, mixin_args(...) included, and
+// are built in place; mixins without an argument are default constructed.
+template <size_t I,template <class X> typename Type>
+struct PikotaroMixin
+{
+    static constexpr size_t index = I;
+    template <class X>
+    using apply = Type<X>;
+};
+
+template <typename... Ms>
+struct PikotaroList {};
+
+template <typename Base,typename M>
+constexpr size_t pikotaro_order = is_empty<typename M::template apply<Base>>::value
+    ? ~size_t(0) : alignof(typename M::template apply<Base>);
+
+template <typename Base,typename M,typename List>
+struct PikotaroInsert;
+template <typename Base,typename M>
+struct PikotaroInsert<Base,M,PikotaroList<>> { using type = PikotaroList<M>; };
+template <typename Base,typename M,typename U,typename... Us>
+struct PikotaroInsert<Base,M,PikotaroList<U,Us...>>
+{
+    template <typename... Vs>
+    static PikotaroList<U,Vs...> prepend(PikotaroList<Vs...>);
+    template <bool first,typename = void>
+    struct pick { using type = PikotaroList<M,U,Us...>; };
+    template <typename Dummy>
+    struct pick<false,Dummy>
+    {
+	using type = decltype(prepend(typename PikotaroInsert<Base,M,PikotaroList<Us...>>::type{}));
+    };
+    using type = typename pick<(pikotaro_order<Base,M> >= pikotaro_order<Base,U>)>::type;
+};
+
+template <typename Base,typename... Ms>
+struct PikotaroSort { using type = PikotaroList<>; };
+template <typename Base,typename M,typename... Ms>
+struct PikotaroSort<Base,M,Ms...>
+{
+    using type = typename PikotaroInsert<Base,M,typename PikotaroSort<Base,Ms...>::type>::type;
+};
+
+template <typename Base,typename List>
+struct PikotaroBases;
+template <typename Base,typename... Ms>
+struct PikotaroBases<Base,PikotaroList<Ms...>> : public PikotaroSlot<typename Ms::template apply<Base>>...
+{
+    // argument of mixin M, forwarded as it was passed
+    template <typename M,typename Tuple>
+    static decltype(auto) arg(Tuple& args)
+    {
+	if constexpr (M::index < tuple_size<Tuple>::value)
+	    return get<M::index>(move(args));
+	else
+	    return PikotaroNone{};
+    }
+    PikotaroBases():PikotaroSlot<typename Ms::template apply<Base>>(PikotaroNone{})...{}
+    template <typename Tuple>
+    PikotaroBases(Tuple args):PikotaroSlot<typename Ms::template apply<Base>>(arg<Ms>(args))...{}
+};
+
+template <typename Base,template <class X> typename... Types,size_t... Is>
+auto pikotaro_sorted(index_sequence<Is...>)
+    -> typename PikotaroSort<Base,PikotaroMixin<Is,Types>...>::type;
+
+template <class Y=nullClass,template <class X> typename... Types>
+struct PikotaroPacked : public PikotaroBases<PikotaroPacked<Y,Types...>,
+					     decltype(pikotaro_sorted<PikotaroPacked<Y,Types...>,Types...>
+						      (index_sequence_for<Types<Y>...>{}))>
+{
+    using Bases = PikotaroBases<PikotaroPacked<Y,Types...>,
+				decltype(pikotaro_sorted<PikotaroPacked<Y,Types...>,Types...>
+					 (index_sequence_for<Types<Y>...>{}))>;
+    PikotaroPacked(){}
+    template<typename... Args,
+	     typename = enable_if_t<!pikotaro_self<PikotaroPacked,Args...>>>
+    PikotaroPacked(Args&&... args):Bases(forward_as_tuple(forward<Args>(args)...)){}
+};
+
+// Compile-time size report: payload is what the mixins really store
+// (nested composites are counted by their own payload), the rest is padding.
+template <typename T>
+struct PikotaroLayout
+{
+    static constexpr size_t payload = is_empty<T>::value ? 0 : sizeof(T);
+};
+
+template <typename C,typename... Ms>
+struct PikotaroLayoutOf
+{
+    static constexpr size_t size = sizeof(C);
+    static constexpr size_t payload = (size_t(0) + ... + PikotaroLayout<Ms>::payload);
+    static constexpr size_t padding = size - payload;
+};
+
+template <class Y,template <class X> typename... Types>
+struct PikotaroLayout<Pikotaro<Y,Types...>>
+    : PikotaroLayoutOf<Pikotaro<Y,Types...>,Types<Pikotaro<Y,Types...>>...> {};
+template <class Y,template <class X> typename... Types>
+struct PikotaroLayout<PikotaroFlat<Y,Types...>>
+    : PikotaroLayoutOf<PikotaroFlat<Y,Types...>,Types<PikotaroFlat<Y,Types...>>...> {};
+template <class Y,template <class X> typename... Types>
+struct PikotaroLayout<PikotaroPacked<Y,Types...>>
+    : PikotaroLayoutOf<PikotaroPacked<Y,Types...>,Types<PikotaroPacked<Y,Types...>>...> {};
+
+template <typename C>
+void layout_report(const char* name)
+{
+    using L = PikotaroLayout<C>;
+    cout<<name<<" Size:"<<L::size<<" Payload:"<<L::payload<<" Padding:"<<L::padding<<endl;
+}
+
+// Mixins that never reach their composite through X (no static_cast<X*>)
+// declare it, which lets PikotaroVector hand them out directly:
+//   template <> constexpr bool pikotaro_standalone<Position> = true;
+template <template <class X> typename Type>
+constexpr bool pikotaro_standalone = false;
+
+// Structure of arrays - every mixin of Pikotaro<Y,Types...> is kept in its
+// own contiguous column, so a loop touching one mixin reads only its data.
+// Columns hold mixins outside of a composite: a CRTP cast there would be
+// undefined, so only pikotaro_standalone mixins are accessible through
+// column() and for_each(). Methods reaching other mixins through CRTP are
+// called on a composite built from the row: v[i].call([](auto& c){ c.draw(); })
+// moves the row's mixins into it and back, v[i].load() returns a copy.
+template <class Y,template <class X> typename... Types>
+class PikotaroVector
+{
+public:
+    using Composite = Pikotaro<Y,Types...>;
+    template <template <class X> typename Type>
+    using Column = vector<Type<Composite>>;
+private:
+    tuple<Column<Types>...> columns;
+
+    template <typename Tuple,size_t... Is>
+    void emplace(Tuple& args,index_sequence<Is...>)
+    {
+	(get<Column<Types>>(columns).push_back(make<Is,Types>(args)), ...);
+    }
+    template <size_t I,template <class X> typename Type,typename Tuple>
+    static Type<Composite> make(Tuple& args)
+    {
+	if constexpr (I < tuple_size<Tuple>::value)
+	    return Type<Composite>(get<I>(move(args)));
+	else
+	    return {};
+    }
+    // Unchecked access - only to copy or move mixins between composites and columns
+    template <template <class X> typename Type>
+    Type<Composite>& cell(size_t i){ return get<Column<Type>>(columns)[i]; }
+public:
+    class Ref
+    {
+	PikotaroVector* vec;
+	size_t index;
+	template <template <class X> typename Type>
+	Type<Composite>& cell(){ return vec->template cell<Type>(index); }
+    public:
+	Ref(PikotaroVector* v,size_t i):vec(v),index(i){}
+	template <template <class X> typename Type>
+	Type<Composite>& get(){ return vec->template column<Type>()[index]; }
+	Composite load(){ return Composite(cell<Types>()...); }
+	void store(const Composite& c){ ((cell<Types>() = static_cast<const Types<Composite>&>(c)), ...); }
+	// f(composite) on the row's mixins, moved into a composite and back
+	template <typename F>
+	decltype(auto) call(F f)
+	{
+	    struct Row
+	    {
+		Ref& ref;
+		Composite c;
+		~Row(){ ((ref.cell<Types>() = move(static_cast<Types<Composite>&>(c))), ...); }
+	    } row {*this,Composite(move(cell<Types>())...)};
+	    return f(row.c);
+	}
+    };
+
+    size_t size() const { return get<0>(columns).size(); }
+    void reserve(size_t n){ (get<Column<Types>>(columns).reserve(n), ...); }
+    template <typename... Args>
+    void emplace_back(Args&&... args)
+    {
+	auto tuple_args = forward_as_tuple(forward<Args>(args)...);
+	emplace(tuple_args,index_sequence_for<Types<Y>...>{});
+    }
+    void push_back(const Composite& c)
+    { (get<Column<Types>>(columns).push_back(static_cast<const Types<Composite>&>(c)), ...); }
+    Ref operator [] (size_t i){ return Ref(this,i); }
+
+    template <template <class X> typename Type>
+    Column<Type>& column()
+    {
+	static_assert(pikotaro_standalone<Type>,
+		      "Mixin may use its composite through CRTP, use it through Ref::call() or load()");
+	return get<Column<Type>>(columns);
+    }
+    // Bulk iteration over one or more columns: f(mixin1, mixin2, ...)
+    template <template <class X> typename... Used,typename F>
+    void for_each(F f)
+    {
+	auto cols = forward_as_tuple(column<Used>()...);
+	for(size_t i = 0, n = size(); i < n; ++i)
+	    apply([&](auto&... col){ f(col[i]...); },cols);
+    }
 };
 
 struct XPen
 {
     string pen;
-    XPen(string s):pen(s){};
+    XPen(string s):pen(move(s)){};
 };
     
 template <class X>
@@ -50,6 +379,7 @@ struct XApple{
 };
 template <class X>
 struct Apple: public XApple{};
+template <> constexpr bool pikotaro_standalone<Apple> = true;
 
 struct XPineapple{
     string color(){return "Pineapple-";}
@@ -58,6 +388,22 @@ struct XPineapple{
 template <class X>
 struct Pineapple: public XPineapple{};
 
+template <class X>
+struct Flag { bool flag = false; };
+template <class X>
+struct Weight { double weight = 0; };
+template <class X>
+struct Tag { char tag = 0; };
+
+// Move-only mixin state
+template <class X>
+struct Handle
+{
+    unique_ptr<string> handle;
+    Handle() = default;
+    Handle(unique_ptr<string> h):handle(move(h)){}
+};
+
 template <typename X>
 using ApplePen = Pikotaro<X,Pen,Apple>;
 template <typename X>
@@ -65,8 +411,63 @@ using PineapplePen = Pikotaro<X,Pen,Pineapple>;
 template <typename X>
 using PenPineappleApplePen = Pikotaro<X,PineapplePen,ApplePen>;
 
-int main()
+// SoA benchmark: composite with a fat cold mixin, hot loop uses two mixins
+template <class X>
+struct Position { double x = 0, y = 0, z = 0; };
+template <class X>
+struct Velocity { double dx = 1, dy = 2, dz = 3; };
+template <> constexpr bool pikotaro_standalone<Position> = true;
+template <> constexpr bool pikotaro_standalone<Velocity> = true;
+template <class X>
+struct Label { string name {"particle"}; double extra[8] {}; };
+
+template <typename F>
+double bench_ns(F f,size_t count)
+{
+    auto start = chrono::steady_clock::now();
+    f();
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double,nano>(stop-start).count()/count;
+}
+
+int bench()
+{
+    constexpr size_t count = 1<<20;
+    constexpr size_t rounds = 20;
+    using Particle = Pikotaro<nullClass,Position,Velocity,Label>;
+    vector<Particle> aos(count);
+    PikotaroVector<nullClass,Position,Velocity,Label> soa;
+    soa.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+	soa.emplace_back();
+
+    double aos_ns = bench_ns([&](){
+	    for(size_t r = 0; r < rounds; ++r)
+		for(auto& p : aos)
+		    {
+			p.x += p.dx;
+			p.y += p.dy;
+			p.z += p.dz;
+		    }
+	},count*rounds);
+    double soa_ns = bench_ns([&](){
+	    for(size_t r = 0; r < rounds; ++r)
+		soa.for_each<Position,Velocity>([](auto& p,auto& v){
+			p.x += v.dx;
+			p.y += v.dy;
+			p.z += v.dz;
+		    });
+	},count*rounds);
+    cout<<"vector<Pikotaro>: "<<aos_ns<<" ns/op ("<<aos[count-1].x<<")"<<endl;
+    cout<<"PikotaroVector:   "<<soa_ns<<" ns/op ("<<soa.column<Position>()[count-1].x<<")"<<endl;
+    return 0;
+}
+
+int main(int argc,const char* argv[])
 {
+    if( argc == 2 && string(argv[1]) == "bench" )
+	return bench();
+
     ApplePen<nullClass> a(string("PenA"));
     PineapplePen<nullClass> b(string("PenB"));
     PenPineappleApplePen<nullClass> c(string("PenA"),string("PenB"));
@@ -78,5 +479,29 @@ int main()
     cout<<"Pen-Pineapple-Apple-Pen Size:"<<sizeof(PenPineappleApplePen<nullClass>)<<endl;
     c.PineapplePen<PenPineappleApplePen<nullClass>>::draw();
 
+    layout_report<ApplePen<nullClass>>("Apple-Pen");
+    layout_report<PenPineappleApplePen<nullClass>>("Pen-Pineapple-Apple-Pen");
+    layout_report<Pikotaro<nullClass,Flag,Weight,Tag,Pineapple>>("Flag-Weight-Tag");
+    layout_report<PikotaroPacked<nullClass,Flag,Weight,Tag,Pineapple>>("Packed Flag-Weight-Tag");
+    PikotaroPacked<nullClass,Pen,Apple> packed(string("PenP"));
+    packed.draw();
+
+    c.broadcast(PIKOTARO_CALL(draw));
+    cout<<"Colors: "<<c.fold(PIKOTARO_CALL(color),plus<string>(),string())<<endl;
+    Pikotaro<nullClass,Flag,Weight,Tag> flags;
+    flags.broadcast([](auto& m) -> decltype(void(m.flag)) { m.flag = true; });
+    cout<<"Flag set by broadcast: "<<flags.flag<<endl;
+
+    Pikotaro<nullClass,Pen,Handle> handled(mixin_args("PenH"),make_unique<string>("Handle"));
+    auto moved = move(handled);
+    cout<<moved.pen<<" owns "<<*moved.handle<<endl;
+
+    PikotaroVector<nullClass,Pen,Apple> pens;
+    pens.emplace_back(string("PenV"));
+    pens.push_back(a);
+    pens.column<Apple>()[1].apple = "Green-Apple-";
+    for(size_t i = 0; i < pens.size(); ++i)
+	pens[i].call([](auto& pen){ pen.draw(); });
+
     return 0;
 }
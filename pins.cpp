@@ -2,18 +2,83 @@
 #include <thread>
 #include <chrono>
 #include <cuchar>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <queue>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 using namespace std;
 
-u_char out_pins[16];
+alignas(uint64_t) u_char out_pins[16];
 
-template < int BYTE, int BIT >
+// Port backends - where Pin and PinSet write. Addresses are known at
+// compile (or link) time, so every write stays a single instruction.
+struct LocalPorts
+{
+    static constexpr size_t size = sizeof(out_pins);
+    template <typename T = u_char>
+    static T* at(size_t offset){ return reinterpret_cast<T*>(out_pins + offset); }
+};
+
+// Register window mmap-ed at a fixed Address: a device (/dev/gpiomem),
+// or a plain file / /dev/shm file as a stand-in another process can watch.
+template <uintptr_t Address,size_t Size = 16>
+struct MappedPorts
+{
+    static_assert(Address % 4096 == 0,"Register window has to be page aligned");
+    static constexpr size_t size = Size;
+    template <typename T = u_char>
+    static volatile T* at(size_t offset){ return reinterpret_cast<volatile T*>(Address + offset); }
+
+    static void map(const char* path,off_t offset = 0,bool create = false)
+    {
+	int fd = open(path,O_RDWR | (create ? O_CREAT : 0),0666);
+	if( fd < 0 )
+	    throw system_error(errno,generic_category(),path);
+	if( create && ftruncate(fd,offset + length()) != 0 )
+	    {
+		int error = errno;
+		close(fd);
+		throw system_error(error,generic_category(),path);
+	    }
+	void* result = mmap(reinterpret_cast<void*>(Address),length(),PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_FIXED_NOREPLACE,fd,offset);
+	close(fd);
+	if( result == MAP_FAILED )
+	    throw system_error(errno,generic_category(),path);
+	if( result != reinterpret_cast<void*>(Address) )
+	    {
+		munmap(result,length());
+		throw system_error(EEXIST,generic_category(),path);
+	    }
+    }
+    static void unmap(){ munmap(reinterpret_cast<void*>(Address),length()); }
+private:
+    static size_t length()
+    {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (Size + page - 1) / page * page;
+    }
+};
+
+template < int BYTE, int BIT, typename PORTS = LocalPorts >
 struct Pin
 {
+    using Ports = PORTS;
     static constexpr int byte = BYTE;
     static constexpr int bit = BIT;
-    static void set(){ out_pins[byte] |= 1u<<bit;}
-    static void reset(){ out_pins[byte] &= (255u^(1<<bit));}
+    static void set(){ *Ports::at(byte) |= 1u<<bit;}
+    static void reset(){ *Ports::at(byte) &= (255u^(1<<bit));}
+    static void toggle(){ *Ports::at(byte) ^= 1u<<bit;}
 };
 
 void delay(int miliseconds)
@@ -34,36 +99,240 @@ void blink()
     delay(_half_T);
 }
 
+// Pins grouped by port byte: masks are computed at compile time and every
+// touched byte gets exactly one read-modify-write, whatever the pin count.
 template < typename PIN, typename... REST>
 struct PinSet
 {
+    using Ports = typename PIN::Ports;
+    static_assert((is_same<Ports,typename REST::Ports>::value && ...),
+		  "PinSet pins have to use the same port backend");
     static constexpr int byte = PIN::byte;
-    static void set()
-	{
-	    PIN::set();
-	    PinSet<REST...>::set();
-	}
-    static void reset()
-	{
-	    PIN::reset();
-	    PinSet<REST...>::reset();
-	}
+    static constexpr size_t ports = Ports::size;
+    struct Masks { u_char mask[ports] {}; };
+    static constexpr Masks masks = []{
+	Masks result;
+	for(auto [b,bit] : {pair<int,int>{PIN::byte,PIN::bit},{REST::byte,REST::bit}...})
+	    result.mask[b] |= 1u<<bit;
+	return result;
+    }();
+
+    static void set(){ set(make_index_sequence<ports>{}); }
+    static void reset(){ reset(make_index_sequence<ports>{}); }
+    static void toggle(){ toggle(make_index_sequence<ports>{}); }
+
+    // Atomic variants switch all pins with one atomic instruction - glitch
+    // free and simultaneous - so all pins have to share one aligned word.
+    static void atomic_set(){ __atomic_fetch_or(word(),word_mask,__ATOMIC_SEQ_CST); }
+    static void atomic_reset(){ __atomic_fetch_and(word(),~word_mask,__ATOMIC_SEQ_CST); }
+    static void atomic_toggle(){ __atomic_fetch_xor(word(),word_mask,__ATOMIC_SEQ_CST); }
+private:
+    template <size_t... Bs>
+    static void set(index_sequence<Bs...>){ (set_port<Bs>(), ...); }
+    template <size_t... Bs>
+    static void reset(index_sequence<Bs...>){ (reset_port<Bs>(), ...); }
+    template <size_t... Bs>
+    static void toggle(index_sequence<Bs...>){ (toggle_port<Bs>(), ...); }
+    template <size_t B>
+    static void set_port(){ if constexpr (masks.mask[B] != 0) *Ports::at(B) |= masks.mask[B]; }
+    template <size_t B>
+    static void reset_port(){ if constexpr (masks.mask[B] != 0) *Ports::at(B) &= u_char(~masks.mask[B]); }
+    template <size_t B>
+    static void toggle_port(){ if constexpr (masks.mask[B] != 0) *Ports::at(B) ^= masks.mask[B]; }
+
+    using Word = uint64_t;
+    static constexpr size_t word_base = size_t(byte) / sizeof(Word) * sizeof(Word);
+    static constexpr Word word_mask = []{
+	static_assert(((size_t(REST::byte) / sizeof(Word) * sizeof(Word) == word_base) && ...),
+		      "Atomic PinSet pins have to share one aligned port word");
+	Word result = 0;
+	for(size_t b = 0; b < sizeof(Word); ++b)
+	    {
+		size_t shift = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? b : sizeof(Word)-1-b;
+		result |= Word(masks.mask[word_base+b]) << (8*shift);
+	    }
+	return result;
+    }();
+    static auto word(){ return Ports::template at<Word>(word_base); }
 };
 
-template <typename PIN>
-struct PinSet<PIN>
+// One write per pin like the former recursive PinSet, but expanded with
+// a fold expression instead of recursion
+template <typename... PINS>
+struct PinSetFlat
 {
-    static void set(){PIN::set();}
-    static void reset(){PIN::reset();}
+    static void set(){ (PINS::set(), ...); }
+    static void reset(){ (PINS::reset(), ...); }
 };
 
 
 
-int main()
+// Waveform engine: many outputs with their own period, duty and phase are
+// merged into one timeline of absolute deadlines, so nothing drifts and
+// all waves keep their phase. One loop sleeps until shortly before the
+// next edge and spins the rest, then reports how late the edges were.
+using WaveClock = chrono::steady_clock;
+
+struct Wave
+{
+    void (*set)();
+    void (*reset)();
+    WaveClock::duration period;
+    WaveClock::duration high;
+    WaveClock::duration phase;
+};
+
+// Compile-time schedule of one Pin or PinSet, times in microseconds
+template <typename PINS, int period, int high, int phase = 0>
+constexpr Wave waveform()
+{
+    static_assert(0 < high && high < period,"Waveform needs both edges within period");
+    return {&PINS::set,&PINS::reset,chrono::microseconds(period),
+	    chrono::microseconds(high),chrono::microseconds(phase)};
+}
+
+struct Jitter
+{
+    size_t edges = 0;
+    WaveClock::duration max {};
+    WaveClock::duration total {};
+    void add(WaveClock::duration late)
+    {
+	++edges;
+	total += late;
+	max = std::max(max,late);
+    }
+};
+
+class WaveEngine
+{
+    struct Edge
+    {
+	WaveClock::time_point deadline;
+	size_t wave;
+	bool rising;
+	bool operator > (const Edge& arg) const { return deadline > arg.deadline; }
+    };
+    vector<Wave> waves;
+    WaveClock::duration spin;
+public:
+    WaveEngine(vector<Wave> arg,WaveClock::duration spin = chrono::microseconds(100))
+	:waves(move(arg)),spin(spin)
+    {
+	for(const Wave& wave : waves)
+	    check(wave);
+    }
+    void add(const Wave& arg){ check(arg); waves.push_back(arg); }
+
+    Jitter run(WaveClock::duration length)
+    {
+	priority_queue<Edge,vector<Edge>,greater<Edge>> timeline;
+	auto start = WaveClock::now();
+	auto stop = start + length;
+	for(size_t i = 0; i < waves.size(); ++i)
+	    timeline.push({start + waves[i].phase,i,true});
+	Jitter jitter;
+	while( !timeline.empty() && timeline.top().deadline < stop )
+	    {
+		auto deadline = timeline.top().deadline;
+		wait_until(deadline);
+		// every edge due by now is switched in this pass
+		while( !timeline.empty() && timeline.top().deadline <= deadline )
+		    {
+			Edge edge = timeline.top();
+			timeline.pop();
+			const Wave& wave = waves[edge.wave];
+			if( edge.rising )
+			    {
+				wave.set();
+				timeline.push({edge.deadline + wave.high,edge.wave,false});
+			    }
+			else
+			    {
+				wave.reset();
+				timeline.push({edge.deadline - wave.high + wave.period,edge.wave,true});
+			    }
+			jitter.add(WaveClock::now() - edge.deadline);
+		    }
+	    }
+	return jitter;
+    }
+private:
+    // Runtime waves get the checks waveform() does at compile time - an
+    // edge outside the period would never advance the timeline
+    static void check(const Wave& wave)
+    {
+	if( !wave.set || !wave.reset )
+	    throw invalid_argument("Waveform without set or reset");
+	if( wave.high <= WaveClock::duration::zero() || wave.high >= wave.period )
+	    throw invalid_argument("Waveform needs both edges within period");
+    }
+    void wait_until(WaveClock::time_point deadline) const
+    {
+	if( deadline - WaveClock::now() > spin )
+	    this_thread::sleep_until(deadline - spin);
+	while( WaveClock::now() < deadline )
+	    ;
+    }
+};
+
+int main(int argc,const char* argv[])
 {
     using pinA1 = Pin<0xF1,0>;
     using PortC = PinSet<Pin<0,0>,Pin<0,1>,Pin<0,2>,Pin<0,3>,Pin<0,4>,Pin<0,5>,Pin<0,6>,Pin<0,7>>;
 
+    if( argc == 2 && string(argv[1]) == "wave" )
+    {
+	WaveEngine engine({waveform<PortC,10000,5000>(),
+			   waveform<Pin<1,0>,1000,250>(),
+			   waveform<PinSet<Pin<1,1>,Pin<2,1>>,3000,1000,500>()});
+	engine.add({&Pin<3,0>::set,&Pin<3,0>::reset,chrono::microseconds(700),
+		    chrono::microseconds(350),chrono::microseconds(0)});
+	Jitter jitter = engine.run(chrono::seconds(2));
+	auto us = [](WaveClock::duration d){ return chrono::duration<double,micro>(d).count(); };
+	cout<<"edges: "<<jitter.edges
+	    <<" mean late: "<<us(jitter.total)/std::max<size_t>(jitter.edges,1)<<" us"
+	    <<" max late: "<<us(jitter.max)<<" us"<<endl;
+	return 0;
+    }
+
+    // Mapped backend: 'pins drive FILE' toggles pins in the mapped FILE,
+    // 'pins observe FILE' samples it from another process.
+    using Mapped = MappedPorts<0x600000000000>;
+    if( argc == 3 && string(argv[1]) == "drive" )
+    {
+	Mapped::map(argv[2],0,true);
+	using Bus = PinSet<Pin<0,0,Mapped>,Pin<0,1,Mapped>,Pin<1,0,Mapped>>;
+	auto stop = chrono::steady_clock::now() + chrono::seconds(2);
+	size_t toggles = 0;
+	while( chrono::steady_clock::now() < stop )
+	{
+	    for(int i = 0; i < 1000; ++i)
+		Bus::toggle();
+	    toggles += 1000;
+	}
+	cout<<"toggles: "<<toggles/2<<" per second"<<endl;
+	Mapped::unmap();
+	return 0;
+    }
+    if( argc == 3 && string(argv[1]) == "observe" )
+    {
+	Mapped::map(argv[2]);
+	size_t samples = 0, changes = 0;
+	u_char last = *Mapped::at(0);
+	auto stop = chrono::steady_clock::now() + chrono::seconds(2);
+	while( chrono::steady_clock::now() < stop )
+	{
+	    u_char now = *Mapped::at(0);
+	    changes += now != last;
+	    last = now;
+	    ++samples;
+	}
+	cout<<"samples: "<<samples<<" changes seen: "<<changes<<endl;
+	Mapped::unmap();
+	return 0;
+    }
+
     while(true)
     {
 	blink<PortC,1000>();
@@ -0,0 +1,125 @@
+#ifndef FAIR_SCHEDULER_H
+#define FAIR_SCHEDULER_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+// Deficit round-robin over many queues, for any number of consumers.
+// Every lane gets quantum*weight elements of credit per visit; credit not
+// used because the queue ran empty is dropped, so idle tenants do not
+// accumulate a burst. Lanes with data are marked in a bitmap and the
+// consumer jumps to the next marked lane with one bit scan per 64 lanes.
+// A consumer claims a lane while serving it; other consumers go on with
+// the next marked one. Producers call mark(i) after pushing to lane i.
+template <typename Queue>
+class FairScheduler
+{
+  struct Lane
+  {
+    Queue* queue = nullptr;
+    std::atomic<unsigned> weight {1};
+    std::atomic<bool> busy {false};
+    long deficit = 0;
+  };
+  size_t m_count;
+  size_t m_words;
+  unsigned m_quantum;
+  std::unique_ptr<Lane[]> m_lanes;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_active;
+  std::atomic<size_t> m_cursor {0};
+public:
+  FairScheduler(size_t count,unsigned quantum = 16)
+    : m_count(count),m_words((count+63)/64),m_quantum(quantum),
+      m_lanes(new Lane[count]),m_active(new std::atomic<uint64_t>[m_words])
+  {
+    for(size_t w = 0; w < m_words; ++w)
+      m_active[w] = 0;
+  }
+  void attach(size_t lane,Queue& queue,unsigned weight = 1)
+  {
+    m_lanes[lane].queue = &queue;
+    set_weight(lane,weight);
+  }
+  void set_weight(size_t lane,unsigned weight)
+  {
+    m_lanes[lane].weight.store(weight ? weight : 1,std::memory_order_relaxed);
+  }
+  unsigned weight(size_t lane) const
+  {
+    return m_lanes[lane].weight.load(std::memory_order_relaxed);
+  }
+  void mark(size_t lane)
+  {
+    uint64_t bit = uint64_t(1) << (lane%64);
+    if( !(m_active[lane/64].load(std::memory_order_relaxed) & bit) )
+      m_active[lane/64].fetch_or(bit,std::memory_order_release);
+  }
+  size_t size() const { return m_count; }
+
+  // Serves one marked lane: pops up to its deficit and calls
+  // sink(lane,value) for each element. Returns the number of elements,
+  // 0 when no lane has data (or all marked lanes are being served).
+  template <typename T,typename Sink>
+  size_t serve(Sink&& sink)
+  {
+    for(size_t tries = 0; tries < m_words+1; ++tries)
+      {
+	size_t lane = next_marked(m_cursor.load(std::memory_order_relaxed));
+	if( lane == m_count )
+	  return 0;
+	m_cursor.store(lane+1 < m_count ? lane+1 : 0,std::memory_order_relaxed);
+	Lane& l = m_lanes[lane];
+	if( l.busy.exchange(true,std::memory_order_acquire) )
+	  continue;
+	size_t served = serve_lane<T>(lane,l,sink);
+	l.busy.store(false,std::memory_order_release);
+	if( served )
+	  return served;
+      }
+    return 0;
+  }
+private:
+  template <typename T,typename Sink>
+  size_t serve_lane(size_t lane,Lane& l,Sink& sink)
+  {
+    l.deficit += long(m_quantum) * l.weight.load(std::memory_order_relaxed);
+    size_t served = 0;
+    T value;
+    while( l.deficit > 0 )
+      {
+	if( !l.queue->wait_and_pop(value) )
+	  {
+	    // ran empty - unmark, then recheck against a racing push+mark
+	    l.deficit = 0;
+	    m_active[lane/64].fetch_and(~(uint64_t(1) << (lane%64)),std::memory_order_acq_rel);
+	    if( l.queue->size() )
+	      mark(lane);
+	    break;
+	  }
+	sink(lane,value);
+	--l.deficit;
+	++served;
+      }
+    return served;
+  }
+  // First marked lane at or after from, wrapping around; m_count if none
+  size_t next_marked(size_t from) const
+  {
+    size_t w = from/64;
+    uint64_t bits = m_active[w].load(std::memory_order_acquire) & (~uint64_t(0) << (from%64));
+    for(size_t i = 0; i <= m_words; ++i)
+      {
+	if( bits )
+	  {
+	    size_t lane = w*64 + __builtin_ctzll(bits);
+	    return lane < m_count ? lane : m_count;
+	  }
+	w = w+1 < m_words ? w+1 : 0;
+	bits = m_active[w].load(std::memory_order_acquire);
+      }
+    return m_count;
+  }
+};
+
+#endif
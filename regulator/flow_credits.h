@@ -0,0 +1,105 @@
+#ifndef FLOW_CREDITS_H
+#define FLOW_CREDITS_H
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+// Flow credits split among many producers without a shared counter.
+// Every tick the regulator issues the commanded flow as credits; each
+// producer claims them in batches from its own pool (one cache line per
+// pool). Credit a pool did not use in the last tick is collected into a
+// spare pool, which producers that ran dry fall back to, and counts toward
+// the next tick's flow - no more than the commanded flow is claimable per
+// tick. The next tick's shares follow the demand each pool has shown -
+// busy producers get more, idle ones less.
+class FlowCredits
+{
+  struct alignas(64) Pool
+  {
+    std::atomic<long> credits {0};
+    std::atomic<long> claimed {0};	// since last issue
+    std::atomic<long> missed {0};	// asked for but not granted since last issue
+    std::atomic<long> total {0};	// claimed since start
+  };
+  size_t m_count;
+  std::unique_ptr<Pool[]> m_pools;
+  alignas(64) std::atomic<long> m_spare {0};
+  std::unique_ptr<double[]> m_share;
+public:
+  explicit FlowCredits(size_t pools)
+    : m_count(pools),m_pools(new Pool[pools]),m_share(new double[pools])
+  {
+    std::fill(m_share.get(),m_share.get()+pools,1.0/pools);
+  }
+  size_t size() const { return m_count; }
+
+  // Regulator side, once per tick: hands out flow credits for the tick
+  void issue(long flow)
+  {
+    double demand_sum = 0;
+    long unused = 0;
+    for(size_t i = 0; i < m_count; ++i)
+      {
+	Pool& p = m_pools[i];
+	unused += p.credits.exchange(0,std::memory_order_acq_rel);
+	// release() after the reset can leave claimed negative
+	long demand = std::max(0L,p.claimed.exchange(0,std::memory_order_relaxed) +
+			       p.missed.exchange(0,std::memory_order_relaxed));
+	// smoothed share of demand, never quite zero so idle pools can restart
+	m_share[i] = 0.5*m_share[i] + 0.5*(demand + 1);
+	demand_sum += m_share[i];
+      }
+    // last tick's leftovers stay claimable from the spare pool, as part
+    // of this tick's flow
+    flow = std::max(0L,flow);
+    long spare = std::clamp(unused,0L,flow);
+    m_spare.exchange(spare,std::memory_order_acq_rel);
+    flow -= spare;
+    long given = 0;
+    for(size_t i = 0; i < m_count; ++i)
+      {
+	long c = i+1 < m_count ? long(flow * m_share[i] / demand_sum) : flow - given;
+	given += c;
+	m_pools[i].credits.fetch_add(c,std::memory_order_release);
+      }
+  }
+
+  // Producer side: claims up to want credits from pool, returns the grant
+  long claim(size_t pool,long want)
+  {
+    Pool& p = m_pools[pool];
+    long got = take(p.credits,want);
+    if( got < want )
+      got += take(m_spare,want - got);
+    if( got < want )
+      p.missed.fetch_add(want - got,std::memory_order_relaxed);
+    p.claimed.fetch_add(got,std::memory_order_relaxed);
+    p.total.fetch_add(got,std::memory_order_relaxed);
+    return got;
+  }
+  // Gives back credits claimed but not used (e.g. the queue was full)
+  void release(size_t pool,long credits)
+  {
+    Pool& p = m_pools[pool];
+    p.credits.fetch_add(credits,std::memory_order_release);
+    p.claimed.fetch_sub(credits,std::memory_order_relaxed);
+    p.total.fetch_sub(credits,std::memory_order_relaxed);
+  }
+  long claimed_total(size_t pool) const { return m_pools[pool].total.load(std::memory_order_relaxed); }
+private:
+  static long take(std::atomic<long>& credits,long want)
+  {
+    long have = credits.load(std::memory_order_relaxed);
+    while( have > 0 )
+      {
+	long got = std::min(have,want);
+	if( credits.compare_exchange_weak(have,have - got,std::memory_order_acquire) )
+	  return got;
+      }
+    return 0;
+  }
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef LANES_QUEUE_H
+#define LANES_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <queue>
+
+// Bounded multi producer / multi consumer ring without locks: every cell
+// carries a sequence number telling whether it is free for the push with
+// that ticket or holds the element for the pop with that ticket.
+template<typename T,size_t T_size>
+class lockfree_ring
+{
+  static_assert((T_size & (T_size-1)) == 0,"Ring size has to be a power of two");
+  struct alignas(64) Cell
+  {
+    std::atomic<size_t> seq;
+    T value;
+  };
+  std::unique_ptr<Cell[]> m_cells;
+  alignas(64) std::atomic<size_t> m_push {0};
+  alignas(64) std::atomic<size_t> m_pop {0};
+public:
+  lockfree_ring()
+    : m_cells(new Cell[T_size])
+  {
+    for(size_t i = 0; i < T_size; ++i)
+      m_cells[i].seq.store(i,std::memory_order_relaxed);
+  }
+  bool push(T new_value)
+  {
+    size_t pos = m_push.load(std::memory_order_relaxed);
+    for(;;)
+      {
+	Cell& c = m_cells[pos % T_size];
+	long diff = long(c.seq.load(std::memory_order_acquire)) - long(pos);
+	if( diff < 0 )
+	  return false;		// full
+	if( diff == 0 )
+	  {
+	    if( m_push.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed) )
+	      {
+		c.value = std::move(new_value);
+		c.seq.store(pos+1,std::memory_order_release);
+		return true;
+	      }
+	  }
+	else
+	  pos = m_push.load(std::memory_order_relaxed);
+      }
+  }
+  bool wait_and_pop(T& value)
+  {
+    size_t pos = m_pop.load(std::memory_order_relaxed);
+    for(;;)
+      {
+	Cell& c = m_cells[pos % T_size];
+	long diff = long(c.seq.load(std::memory_order_acquire)) - long(pos+1);
+	if( diff < 0 )
+	  return false;		// empty
+	if( diff == 0 )
+	  {
+	    if( m_pop.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed) )
+	      {
+		value = std::move(c.value);
+		c.seq.store(pos+T_size,std::memory_order_release);
+		return true;
+	      }
+	  }
+	else
+	  pos = m_pop.load(std::memory_order_relaxed);
+      }
+  }
+  // Approximate under concurrent use
+  size_t size() const
+  {
+    size_t pop = m_pop.load(std::memory_order_acquire);
+    size_t push = m_push.load(std::memory_order_acquire);
+    return push > pop ? push - pop : 0;
+  }
+};
+
+// threadsafe_queue with Priorities lanes in front of the bulk lane. A
+// priority lane is a small lock-free ring of Bound elements, so urgent
+// elements never wait behind bulk traffic and neither side takes the bulk
+// mutex for them. Consumers check lanes in priority order (0 first); the
+// bulk lane is looked at, and locked, only when the priority lanes are
+// empty and its atomic count says it has data. size() and
+// set_size_limit() refer to the bulk lane only - that is the depth the
+// Regulator controls.
+template<typename T,size_t Priorities = 1,size_t Bound = 64>
+class lanes_queue
+{
+private:
+  lockfree_ring<T,Bound> lanes[Priorities];
+  alignas(64) mutable std::mutex mut;
+  std::queue<T> data_queue;
+  std::atomic<size_t> bulk_count { 0 };
+  std::atomic<size_t> size_limit { 1000000 };
+public:
+  lanes_queue()
+  {}
+
+  // Bulk lane
+  bool push(T new_value)
+  {
+    std::lock_guard<std::mutex> lk(mut);
+    if ( m_full() )
+      return false;
+    data_queue.push(std::move(new_value));
+    bulk_count.store(data_queue.size(),std::memory_order_release);
+    return true;
+  }
+  // Priority lane, 0 is the most urgent; false when that lane is full
+  bool push(T new_value,size_t priority)
+  {
+    return lanes[priority].push(std::move(new_value));
+  }
+  bool wait_and_pop(T& value)
+  {
+    for(auto& lane : lanes)
+      if( lane.wait_and_pop(value) )
+	return true;
+    if( !bulk_count.load(std::memory_order_acquire) )
+      return false;
+    std::lock_guard<std::mutex> lk(mut);
+    if( m_empty() )
+      return false;
+    value=std::move(data_queue.front());
+    data_queue.pop();
+    bulk_count.store(data_queue.size(),std::memory_order_release);
+    return true;
+  }
+  size_t size() const
+  {
+    return bulk_count.load(std::memory_order_acquire);
+  }
+  size_t size(size_t priority) const
+  {
+    return lanes[priority].size();
+  }
+  void set_size_limit(size_t limit)
+  {
+    size_limit.store(limit);
+  }
+private:
+  size_t m_size() const
+  {
+    return data_queue.size();
+  }
+  bool m_full() const
+  {
+    return m_size() >= size_limit;
+  }
+  bool m_empty() const
+  {
+    return data_queue.empty();
+  }
+};
+
+#endif
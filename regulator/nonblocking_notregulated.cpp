@@ -9,6 +9,8 @@
 #include <memory>
 #include <atomic>
 
+#include "stack_profiler.h"
+
 template<typename T, int T_size = 32768 >
 class nonblocking_queue
 {
@@ -126,7 +128,7 @@ constexpr int setpointSize2 = 50000;
 
 int main(int argc,const char* argv[])
 {
-  std::thread insThread([](){
+  StackProfiledThread insThread("insThread",[](){
 			  int* x=0;
 			  x = new int {cin.get()};
 			  while(!finFlag)
@@ -141,7 +143,7 @@ int main(int argc,const char* argv[])
 			      inFlow.fetch_add(success);
 			    }
 			});
-  std::thread remThread([](){
+  StackProfiledThread remThread("remThread",[](){
 			  int* x=0;
 			  while(!finFlag)
 			    {
@@ -156,7 +158,7 @@ int main(int argc,const char* argv[])
 			      outFlow.fetch_add(success);
 			    }
 			});
-  std::thread chBufSetpoint([]()
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[]()
   			    {
   			      int x = false;
 			      while(!finFlag)
@@ -181,7 +183,7 @@ int main(int argc,const char* argv[])
       std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
     }
   finFlag = true;
-  insThread.join();
-  remThread.join();
-  chBufSetpoint.join();
+  insThread.join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
 }
@@ -9,6 +9,8 @@
 #include <memory>
 #include <atomic>
 
+#include "stack_profiler.h"
+
 template<typename T>
 class threadsafe_queue
 {
@@ -73,7 +75,7 @@ constexpr int setpointSize2 = 50000;
 
 int main(int argc,const char* argv[])
 {
-  std::thread insThread([](){
+  StackProfiledThread insThread("insThread",[](){
 			  int x=0;
 			  x = cin.get();
 			  while(!finFlag)
@@ -89,7 +91,7 @@ int main(int argc,const char* argv[])
 			      //std::this_thread::yield();
 			    }
 			});
-  std::thread remThread([](){
+  StackProfiledThread remThread("remThread",[](){
 			  int x=0;
 			  while(!finFlag)
 			    {
@@ -104,7 +106,7 @@ int main(int argc,const char* argv[])
 			      //std::this_thread::yield();
 			    }
 			});
-  std::thread chBufSetpoint([]()
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[]()
   			    {
   			      int x = false;
 			      while(!finFlag)
@@ -129,7 +131,7 @@ int main(int argc,const char* argv[])
       std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
     }
   finFlag = true;
-  insThread.join();
-  remThread.join();
-  chBufSetpoint.join();
+  insThread.join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
 }
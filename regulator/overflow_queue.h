@@ -0,0 +1,321 @@
+#ifndef OVERFLOW_QUEUE_H
+#define OVERFLOW_QUEUE_H
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+// Append-only spill storage: elements are copied into mmap-ed segment
+// files one after another and read back in the same order, a chunk at a
+// time. Segment files are unlinked as soon as they are mapped, so a crash
+// leaves none behind. One spare segment is kept for the next switch: a
+// fully read segment becomes the spare, or is unmapped if there is one.
+// create() needs no lock, so the owner can make the spare outside of its
+// locks when needs_spare() says so.
+template<typename T>
+class SpillFile
+{
+  static_assert(std::is_trivially_copyable<T>::value,"Only trivially copyable elements can be spilled");
+public:
+  struct Segment
+  {
+    T* data = nullptr;
+  };
+private:
+  std::string m_prefix;
+  size_t m_capacity;
+  std::deque<Segment> m_segments;
+  Segment m_spare;
+  size_t m_write = 0;
+  size_t m_read = 0;
+  size_t m_count = 0;
+  std::atomic<size_t> m_next_id { 0 };
+public:
+  // dir: where segment files go, elements: segment size in elements
+  SpillFile(std::string dir = "/tmp",size_t elements = 1<<18)
+    : m_prefix(dir + "/spill." + std::to_string(getpid()) + "." +
+	       std::to_string(reinterpret_cast<uintptr_t>(this)) + "."),
+      m_capacity(elements)
+  {}
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+  ~SpillFile()
+  {
+    while( !m_segments.empty() )
+      drop_front();
+    release(m_spare);
+  }
+  size_t size() const { return m_count; }
+  bool empty() const { return m_count == 0; }
+  bool needs_spare() const { return !m_spare.data; }
+
+  void push(const T& value)
+  {
+    if( m_segments.empty() || m_write == m_capacity )
+      {
+	m_segments.push_back(m_spare.data ? std::move(m_spare) : create());
+	m_spare = {};
+	m_write = 0;
+      }
+    std::memcpy(m_segments.back().data + m_write++,&value,sizeof(T));
+    ++m_count;
+  }
+  // Copies up to max oldest elements to the output iterator out, returns how many
+  template <typename Out>
+  size_t read(Out out,size_t max)
+  {
+    size_t done = 0;
+    while( done < max && m_count )
+      {
+	size_t end = m_segments.size() == 1 ? m_write : m_capacity;
+	size_t n = std::min(max - done,end - m_read);
+	const T* data = m_segments.front().data;
+	out = std::copy(data + m_read,data + m_read + n,out);
+	m_read += n;
+	m_count -= n;
+	done += n;
+	if( m_read == m_capacity || (m_count == 0 && m_segments.size() == 1) )
+	  {
+	    drop_front();
+	    m_read = 0;
+	    if( m_segments.empty() )
+	      m_write = 0;
+	  }
+      }
+    return done;
+  }
+  // Hands over a segment made by create(), released if a spare is already there
+  void add_spare(Segment segment)
+  {
+    if( m_spare.data )
+      release(segment);
+    else
+      m_spare = std::move(segment);
+  }
+  // New segment file, safe to call concurrently with everything else
+  Segment create()
+  {
+    std::string path = m_prefix + std::to_string(m_next_id++);
+    int fd = open(path.c_str(),O_RDWR | O_CREAT | O_TRUNC,0600);
+    if( fd < 0 )
+      throw std::system_error(errno,std::generic_category(),path);
+    if( ftruncate(fd,bytes()) != 0 )
+      {
+	int error = errno;
+	close(fd);
+	unlink(path.c_str());
+	throw std::system_error(error,std::generic_category(),path);
+      }
+    void* data = mmap(nullptr,bytes(),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    int error = errno;
+    close(fd);
+    // the mapping keeps the file, so a crash leaves nothing behind
+    unlink(path.c_str());
+    if( data == MAP_FAILED )
+      throw std::system_error(error,std::generic_category(),path);
+    madvise(data,bytes(),MADV_SEQUENTIAL);
+    return {static_cast<T*>(data)};
+  }
+private:
+  size_t bytes() const { return m_capacity * sizeof(T); }
+  void release(Segment& segment)
+  {
+    if( !segment.data )
+      return;
+    munmap(segment.data,bytes());
+    segment = {};
+  }
+  void drop_front()
+  {
+    add_spare(std::move(m_segments.front()));
+    m_segments.pop_front();
+  }
+};
+
+// What push does when the in-memory queue is at size_limit
+enum class Overflow
+{
+  block,       // wait until the consumer makes room
+  drop_newest, // discard the pushed element
+  drop_oldest, // discard the oldest queued element to make room
+  spill        // append to SpillFile, replayed in order as the queue drains
+};
+
+// threadsafe_queue with an overflow policy. push returns false only when
+// the element was discarded (or the queue was closed while blocking).
+// The spill file has its own lock, spill_mut, so file writes, segment
+// creation and refill reads never hold up the in-memory queue; when both
+// are taken, spill_mut comes first.
+template<typename T,Overflow Policy>
+class overflow_queue
+{
+private:
+  mutable std::mutex mut;
+  std::mutex spill_mut;
+  std::condition_variable not_full;
+  std::queue<T> data_queue;
+  std::atomic<size_t> size_limit { 1000000 };
+  std::atomic<size_t> dropped_count { 0 };
+  std::atomic<size_t> spilled_count { 0 };
+  std::conditional_t<Policy == Overflow::spill,SpillFile<T>,char> spill;
+  // read from the spill file but not queued yet, under spill_mut
+  std::conditional_t<Policy == Overflow::spill,std::vector<T>,char> chunk;
+  size_t chunk_pos = 0;
+  bool closed = false;
+public:
+  overflow_queue() = default;
+  template <Overflow P = Policy,typename = std::enable_if_t<P == Overflow::spill>>
+  overflow_queue(std::string spill_dir,size_t segment_elements = 1<<18)
+    : spill(std::move(spill_dir),segment_elements)
+  {}
+
+  bool push(T new_value)
+  {
+    std::unique_lock<std::mutex> lk(mut);
+    if constexpr (Policy == Overflow::spill)
+      // once spilling, newer elements queue up behind the spilled ones
+      if( spilled_count || m_full() )
+	{
+	  lk.unlock();
+	  spill_push(new_value);
+	  return true;
+	}
+    if( m_full() )
+      {
+	if constexpr (Policy == Overflow::block)
+	  {
+	    not_full.wait(lk,[this](){ return !m_full() || closed; });
+	    if( closed )
+	      return false;
+	  }
+	if constexpr (Policy == Overflow::drop_newest)
+	  {
+	    ++dropped_count;
+	    return false;
+	  }
+	if constexpr (Policy == Overflow::drop_oldest)
+	  {
+	    ++dropped_count;
+	    // size_limit 0: nothing queued to make room with
+	    if( m_empty() )
+	      return false;
+	    data_queue.pop();
+	  }
+      }
+    data_queue.push(std::move(new_value));
+    return true;
+  }
+  bool wait_and_pop(T& value)
+  {
+    if constexpr (Policy == Overflow::spill)
+      if( spilled_count )
+	refill();
+    std::lock_guard<std::mutex> lk(mut);
+    if( m_empty() )
+      return false;
+    value=std::move(data_queue.front());
+    data_queue.pop();
+    if constexpr (Policy == Overflow::block)
+      not_full.notify_one();
+    return true;
+  }
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lk(mut);
+    return m_size();
+  }
+  void set_size_limit(size_t limit)
+  {
+    if constexpr (Policy == Overflow::block)
+      {
+	// under mut, so a producer between its check and its wait sees it
+	{
+	  std::lock_guard<std::mutex> lk(mut);
+	  size_limit.store(limit);
+	}
+	not_full.notify_all();
+      }
+    else
+      size_limit.store(limit);
+  }
+  // Wakes producers blocked in push, they return false
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lk(mut);
+      closed = true;
+    }
+    not_full.notify_all();
+  }
+  size_t dropped() const { return dropped_count; }
+  size_t spilled() const { return spilled_count; }
+private:
+  void spill_push(const T& value)
+  {
+    {
+      std::lock_guard<std::mutex> sk(spill_mut);
+      spill.push(value);
+      spilled_count = spill.size() + chunk.size() - chunk_pos;
+      if( !spill.needs_spare() )
+	return;
+    }
+    // the next segment file is made while no lock is held
+    auto segment = spill.create();
+    std::lock_guard<std::mutex> sk(spill_mut);
+    spill.add_spare(std::move(segment));
+  }
+  // Refills the queue in chunks, sequential reads of the spill segments.
+  // The chunk is read from the segments under spill_mut only and appended
+  // under mut, as far as there is room then - the rest waits in chunk for
+  // the next refill. spilled_count drops after the append, so producers
+  // keep spilling until the spilled elements are queued ahead of theirs.
+  void refill()
+  {
+    std::lock_guard<std::mutex> sk(spill_mut);
+    if( chunk_pos == chunk.size() )
+      {
+	size_t room;
+	{
+	  std::lock_guard<std::mutex> lk(mut);
+	  if( m_size() > size_limit/2 )
+	    return;
+	  room = size_limit - m_size();
+	}
+	chunk.clear();
+	chunk_pos = 0;
+	spill.read(std::back_inserter(chunk),room);
+      }
+    {
+      std::lock_guard<std::mutex> lk(mut);
+      while( chunk_pos < chunk.size() && !m_full() )
+	data_queue.push(chunk[chunk_pos++]);
+    }
+    spilled_count = spill.size() + chunk.size() - chunk_pos;
+  }
+  size_t m_size() const
+  {
+    return data_queue.size();
+  }
+  bool m_full() const
+  {
+    return m_size() >= size_limit;
+  }
+  bool m_empty() const
+  {
+    return data_queue.empty();
+  }
+};
+
+#endif
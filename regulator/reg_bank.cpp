@@ -0,0 +1,112 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <atomic>
+
+#include "stack_profiler.h"
+#include "regulator.h"
+#include "regulator_bank.h"
+
+// Thousands of buffers, each with its own P loop, regulated by one thread.
+// Buffers are simulated: every tick a buffer gets setpointFlow plus its
+// loop output and loses its own drain rate. chBufSetpoint moves the size
+// setpoints of half of the buffers every second.
+//   reg_bank [k] [loops]
+std::atomic<bool> finFlag {false};
+std::atomic<long> bankNs {0};
+std::atomic<long> ticks {0};
+// measurements of buffers 0 and 1 for the monitor - the bank belongs to regThread
+std::atomic<float> size0 {0};
+std::atomic<float> size1 {0};
+
+constexpr float setpointFlow = 2000;
+constexpr float setpointSize1 = 10000;
+constexpr float setpointSize2 = 50000;
+
+using namespace std;
+
+int main(int argc,const char* argv[])
+{
+  float k = (argc >= 2)? std::stof(argv[1]) : 0.05f;
+  size_t loops = (argc >= 3)? std::stoul(argv[2]) : 4096;
+
+  RegulatorBank bank(loops);
+  std::vector<float> sizes(loops,0),drain(loops);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> rate(1500,2500);
+  for(size_t i = 0; i < loops; ++i)
+    {
+      bank.add(k,setpointSize1,setpointFlow);
+      drain[i] = rate(gen);
+    }
+
+  StackProfiledThread regThread("regThread",[&](){
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      std::copy(sizes.begin(),sizes.end(),bank.measurements());
+			      bank.update();
+			      size0.store(bank.measurement(0),std::memory_order_relaxed);
+			      if( loops > 1 )
+				size1.store(bank.measurement(1),std::memory_order_relaxed);
+			      bankNs += std::chrono::duration_cast<std::chrono::nanoseconds>
+				(std::chrono::steady_clock::now()-now).count();
+			      ++ticks;
+			      for(size_t i = 0; i < loops; ++i)
+				sizes[i] = std::max(0.0f,sizes[i] + std::max(0.0f,bank.output(i)) - drain[i]);
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&]()
+			    {
+			      int x = false;
+			      while(!finFlag)
+				{
+				  auto now = std::chrono::steady_clock::now();
+				  float size = (x = !x) ? setpointSize1 : setpointSize2;
+				  for(size_t i = 0; i < loops; i += 2)
+				    bank.request_setpoint(i,size,setpointFlow);
+				  std::this_thread::sleep_until(now+std::chrono::seconds(1));
+				}
+			    });
+
+  auto start = std::chrono::steady_clock::now();
+  cerr<<"time size0 size1 updateNs\n";
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      long t = ticks.exchange(0);
+      long ns = bankNs.exchange(0);
+      cerr<<time_c<<' '<<size0.load(std::memory_order_relaxed)<<' '<<size1.load(std::memory_order_relaxed)<<' '<<(t ? ns/t : 0)<<'\n';
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  regThread.join(cerr);
+  chBufSetpoint.join(cerr);
+
+  // one pass of the bank against the same loops as Regulator objects
+  std::vector<std::atomic<int>> reg(loops),ctrl(loops);
+  using Reg = decltype(makeRegulator(reg[0],ctrl[0],10000,2000,k));
+  std::vector<Reg> regs;
+  for(size_t i = 0; i < loops; ++i)
+    regs.push_back(makeRegulator(reg[i],ctrl[i],10000,2000,k));
+  constexpr int rounds = 1000;
+  auto t0 = std::chrono::steady_clock::now();
+  for(int r = 0; r < rounds; ++r)
+    bank.update();
+  auto t1 = std::chrono::steady_clock::now();
+  for(int r = 0; r < rounds; ++r)
+    for(auto& rg : regs)
+      rg.update();
+  auto t2 = std::chrono::steady_clock::now();
+  auto per_loop = [&](auto d){ return std::chrono::duration<double,std::nano>(d).count()/rounds/loops; };
+  cerr<<"# RegulatorBank: "<<per_loop(t1-t0)<<" ns/loop, Regulator: "<<per_loop(t2-t1)<<" ns/loop\n";
+}
@@ -8,6 +8,8 @@
 #include <mutex>
 #include <memory>
 #include <atomic>
+
+#include "stack_profiler.h"
 #include <condition_variable>
 
 template<typename T>
@@ -102,7 +104,7 @@ using namespace std;
 
 int main(int argc,const char* argv[])
 {
-  std::thread insThread([](){
+  StackProfiledThread insThread("insThread",[](){
 			  int x=0;
 			  x = cin.get();
 			  while(!finFlag)
@@ -119,7 +121,7 @@ int main(int argc,const char* argv[])
 			      inFlow.fetch_add(success);
 			    }
 			});
-  std::thread remThread([](){
+  StackProfiledThread remThread("remThread",[](){
 			  int x=0;
 			  while(!finFlag)
 			    {
@@ -134,7 +136,7 @@ int main(int argc,const char* argv[])
 			      outFlow.fetch_add(success);
 			    }
 			});
-    std::thread chBufSetpoint([]()
+    StackProfiledThread chBufSetpoint("chBufSetpoint",[]()
   			    {
   			      int x = false;
 				while(!finFlag)
@@ -162,7 +164,7 @@ int main(int argc,const char* argv[])
   finFlag = true;
   tsq.notify();
   tsq.notify();
-  insThread.join();
-  remThread.join();
-  chBufSetpoint.join();
+  insThread.join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
 }
@@ -0,0 +1,141 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include <vector>
+
+#include "stack_profiler.h"
+#include "regulator.h"
+#include "flow_credits.h"
+
+// Several producers feed one buffer. The Regulator output plus the flow
+// setpoint is issued every millisecond as flow credits; each producer
+// claims batches from its own pool, so total inflow follows the regulator
+// without a counter shared by all producers. Producers differ in speed,
+// unused credit of the slow ones goes to the fast ones.
+//   reg_credits [k]
+constexpr size_t producers = 4;
+constexpr long batch = 50;
+constexpr int setpointFlow = 2000;
+constexpr int consumerFlow = 2000;
+constexpr int setpointSize1 = 10000;
+constexpr int setpointSize2 = 50000;
+
+std::atomic<int> diffFlow {0};
+std::atomic<int> buffSize {0};
+std::atomic<bool> finFlag {false};
+threadsafe_queue<int> tsq;
+FlowCredits credits(producers);
+
+using namespace std;
+
+int main(int argc,const char* argv[])
+{
+  float k = (argc == 2)? std::stof(argv[1]) : 0.1f;
+  auto reg = makeRegulator(buffSize,diffFlow,setpointSize1,0,k);
+
+  StackProfiledThread regThread("regThread",[&reg](){
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      buffSize = tsq.size();
+			      reg.update();
+			      credits.issue(setpointFlow + diffFlow.load());
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  auto producer = [](size_t id){
+		    // producer id limits its speed: at most (id+1)*300 per ms
+		    int x = 0;
+		    while(!finFlag)
+		      {
+			auto now = std::chrono::steady_clock::now();
+			long budget = (id+1)*300;
+			while( budget > 0 && !finFlag )
+			  {
+			    long got = credits.claim(id,std::min(batch,budget));
+			    if( !got ) break;
+			    long pushed = 0;
+			    while( pushed < got && tsq.push(++x) )
+			      ++pushed;
+			    if( pushed < got )
+			      credits.release(id,got - pushed);
+			    budget -= got;
+			    if( pushed < got ) break;
+			  }
+			std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+		      }
+		  };
+  std::vector<std::unique_ptr<StackProfiledThread>> insThreads;
+  for(size_t i = 0; i < producers; ++i)
+    insThreads.emplace_back(new StackProfiledThread("insThread" + std::to_string(i),
+						    [producer,i](){ producer(i); }));
+  StackProfiledThread remThread("remThread",[](){
+			  int x=0;
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      for(int i = 0; i < consumerFlow && tsq.wait_and_pop(x); ++i);
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&reg]()
+			    {
+			      int x = false;
+			      while(!finFlag)
+				{
+				  auto now = std::chrono::steady_clock::now();
+				  if( (x = !x) )
+				    {
+				      tsq.set_size_limit(setpointSize1+10000);
+				      reg.setpoint(setpointSize1,0);
+				    }
+				  else
+				    {
+				      tsq.set_size_limit(setpointSize2+20000);
+				      reg.setpoint(setpointSize2,0);
+				    }
+				  std::this_thread::sleep_until(now+std::chrono::seconds(1));
+				}
+			    });
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<long> last(producers,0);
+  cerr<<"time buffSize commanded inFlow";
+  for(size_t i = 0; i < producers; ++i)
+    cerr<<" inFlow"<<i;
+  cerr<<'\n';
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      long in = 0;
+      std::vector<long> flows(producers);
+      for(size_t i = 0; i < producers; ++i)
+	{
+	  long total = credits.claimed_total(i);
+	  flows[i] = total - last[i];
+	  last[i] = total;
+	  in += flows[i];
+	}
+      cerr<<time_c<<' '<<buffSize<<' '<<setpointFlow + diffFlow<<' '<<in;
+      for(long f : flows)
+	cerr<<' '<<f;
+      cerr<<'\n';
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  regThread.join(cerr);
+  for(auto& t : insThreads)
+    t->join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
+}
@@ -0,0 +1,125 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstdlib>
+
+#include "stack_profiler.h"
+#include "overflow_queue.h"
+
+// Bursty producer against a steady consumer with a small in-memory queue.
+// The overflow policy is chosen on the command line:
+//   reg_overflow block|drop-newest|drop-oldest|spill [spill dir]
+// Elements are sequence numbers, so the consumer counts lost and
+// reordered ones.
+
+std::atomic<int> inFlow {0};
+std::atomic<int> outFlow {0};
+std::atomic<bool> finFlag {false};
+using namespace std;
+
+constexpr int sizeLimit = 10000;
+constexpr int consumerRate = 500;	// elements per ms
+constexpr int burstRate = 1000;		// elements per ms during a burst
+
+template <Overflow Policy>
+int run(overflow_queue<int,Policy>& tsq)
+{
+  tsq.set_size_limit(sizeLimit);
+  std::atomic<long> pushed {0};
+  long received = 0, lost = 0, reordered = 0;
+
+  StackProfiledThread insThread("insThread",[&](){
+			  int x = 0;
+			  auto start = std::chrono::steady_clock::now();
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now-start).count();
+			      // 300 ms burst every second
+			      if( ms % 1000 < 300 )
+				{
+				  int success = 0;
+				  for(int i = 0; i < burstRate && !finFlag; ++i)
+				    {
+				      success += tsq.push(x++);
+				      ++pushed;
+				    }
+				  inFlow.fetch_add(success);
+				}
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread remThread("remThread",[&](){
+			  int x = 0, last = -1;
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      int success = 0;
+			      while( success < consumerRate && tsq.wait_and_pop(x) )
+				{
+				  if( x < last ) ++reordered;
+				  else lost += x - last - 1;
+				  last = x;
+				  ++success;
+				}
+			      received += success;
+			      outFlow.fetch_add(success);
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+
+  auto start = std::chrono::steady_clock::now();
+  cerr<<"time buffSize spilled dropped inFlow outFlow\n";
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      cerr<<time_c<<' '<<tsq.size()<<' '<<tsq.spilled()<<' '<<tsq.dropped()
+	  <<' '<<inFlow<<' '<<outFlow<<'\n';
+      inFlow = 0;
+      outFlow = 0;
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  tsq.close();
+  insThread.join(cerr);
+  remThread.join(cerr);
+  cerr<<"# pushed "<<pushed<<" received "<<received<<" lost "<<lost
+      <<" reordered "<<reordered<<" still queued "<<tsq.size()+tsq.spilled()<<'\n';
+  return 0;
+}
+
+int main(int argc,const char* argv[])
+{
+  std::string policy = argc >= 2 ? argv[1] : "spill";
+  if( policy == "block" )
+    {
+      static overflow_queue<int,Overflow::block> tsq;
+      return run(tsq);
+    }
+  if( policy == "drop-newest" )
+    {
+      static overflow_queue<int,Overflow::drop_newest> tsq;
+      return run(tsq);
+    }
+  if( policy == "drop-oldest" )
+    {
+      static overflow_queue<int,Overflow::drop_oldest> tsq;
+      return run(tsq);
+    }
+  if( policy == "spill" )
+    {
+      static overflow_queue<int,Overflow::spill> tsq(argc >= 3 ? argv[2] : "/tmp");
+      return run(tsq);
+    }
+  cerr<<"usage: "<<argv[0]<<" block|drop-newest|drop-oldest|spill [spill dir]\n";
+  return 1;
+}
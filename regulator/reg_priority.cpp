@@ -0,0 +1,161 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "stack_profiler.h"
+#include "regulator.h"
+#include "lanes_queue.h"
+
+// The data plane keeps the bulk lane at the regulated depth (tens of
+// thousands of elements), while a control thread sends one urgent message
+// per ms and the consumer measures how long it took to get through.
+//   reg_priority [k] [fifo]
+// fifo sends control messages through the bulk lane, for comparison.
+struct Msg
+{
+  int64_t sent;		// ns, 0 for bulk elements
+  int value;
+};
+
+constexpr int setpointFlow = 2000;
+constexpr int consumerFlow = 2000;
+constexpr int setpointSize1 = 10000;
+constexpr int setpointSize2 = 50000;
+
+std::atomic<int> diffFlow {0};
+std::atomic<int> buffSize {0};
+std::atomic<bool> finFlag {false};
+lanes_queue<Msg> tsq;
+
+std::atomic<int> inFlow {0};
+std::atomic<int> outFlow {0};
+std::atomic<int64_t> ctrlMaxUs {0};
+std::atomic<int64_t> ctrlWorstUs {0};
+std::atomic<long> ctrlLost {0};
+
+int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>
+    (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record_max(std::atomic<int64_t>& max,int64_t value)
+{
+  int64_t old = max.load(std::memory_order_relaxed);
+  while( value > old && !max.compare_exchange_weak(old,value,std::memory_order_relaxed) );
+}
+
+using namespace std;
+
+int main(int argc,const char* argv[])
+{
+  float k = (argc >= 2)? std::stof(argv[1]) : 0.1f;
+  bool fifo = argc >= 3 && !std::strcmp(argv[2],"fifo");
+  auto reg = makeRegulator(buffSize,diffFlow,setpointSize1,0,k);
+
+  StackProfiledThread regThread("regThread",[&reg](){
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      buffSize = tsq.size();
+			      reg.update();
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread insThread("insThread",[](){
+			  int x = 0;
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      int flow = setpointFlow + diffFlow.load();
+			      int success = 0;
+			      while( success < flow && tsq.push(Msg{0,++x}) )
+				++success;
+			      inFlow.fetch_add(success);
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread ctrlThread("ctrlThread",[fifo](){
+			  int x = 0;
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      Msg m{now_ns(),++x};
+			      if( !(fifo ? tsq.push(m) : tsq.push(m,0)) )
+				++ctrlLost;
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread remThread("remThread",[](){
+			  Msg m;
+			  auto received = [&m](){
+			    if( m.sent )
+			      {
+				int64_t us = (now_ns() - m.sent)/1000;
+				record_max(ctrlMaxUs,us);
+				record_max(ctrlWorstUs,us);
+			      }
+			  };
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      auto tick = now+std::chrono::milliseconds(1);
+			      int success = 0;
+			      for(; success < consumerFlow && tsq.wait_and_pop(m); ++success)
+				received();
+			      // Till the next tick only the priority lane is served,
+			      // polled every 50 us; bulk elements wait for the tick.
+			      while( (now = std::chrono::steady_clock::now()) < tick )
+				{
+				  for(; tsq.size(0) && tsq.wait_and_pop(m); ++success)
+				    received();
+				  std::this_thread::sleep_until(std::min(now+std::chrono::microseconds(50),tick));
+				}
+			      outFlow.fetch_add(success);
+			    }
+			});
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&reg]()
+			    {
+			      int x = false;
+			      while(!finFlag)
+				{
+				  auto now = std::chrono::steady_clock::now();
+				  int size = (x = !x) ? setpointSize1 : setpointSize2;
+				  tsq.set_size_limit(size + size/2);
+				  reg.setpoint(size,0);
+				  std::this_thread::sleep_until(now+std::chrono::seconds(1));
+				}
+			    });
+
+  auto start = std::chrono::steady_clock::now();
+  cerr<<"time buffSize inFlow outFlow ctrlMaxUs\n";
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      cerr<<time_c<<' '<<buffSize<<' '<<inFlow<<' '<<outFlow<<' '<<ctrlMaxUs<<'\n';
+      inFlow = 0;
+      outFlow = 0;
+      ctrlMaxUs = 0;
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  cerr<<"# control messages: worst latency "<<ctrlWorstUs<<" us, lost "<<ctrlLost<<'\n';
+  regThread.join(cerr);
+  insThread.join(cerr);
+  ctrlThread.join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
+}
@@ -0,0 +1,124 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <optional>
+
+#include "stack_profiler.h"
+#include "regulator.h"
+#include "shm_queue.h"
+
+// Producer and consumer in separate processes, connected by shm_queue:
+//   reg_shm producer NAME [k] < input
+//   reg_shm consumer NAME [k] > output
+// The process given k runs the Regulator: it reads the shared queue size
+// and writes the flow correction to the shared control value, which the
+// producer adds to its flow setpoint. Each side stops when the peer dies.
+std::atomic<int> buffSize {0};
+std::atomic<int> flow {0};
+std::atomic<bool> finFlag {false};
+
+constexpr int setpointFlow = 2000;
+constexpr int setpointSize1 = 10000;
+constexpr int setpointSize2 = 30000;
+
+using namespace std;
+
+int main(int argc,const char* argv[])
+{
+  if( argc < 3 || (string(argv[1]) != "producer" && string(argv[1]) != "consumer") )
+    {
+      cerr<<"usage: "<<argv[0]<<" producer|consumer NAME [k]\n";
+      return 1;
+    }
+  bool is_producer = string(argv[1]) == "producer";
+  bool regulate = argc == 4;
+  float k = regulate ? std::stof(argv[3]) : 0.0f;
+  using Queue = shm_queue<int>;
+  Queue tsq(argv[2],is_producer ? Queue::producer : Queue::consumer);
+  // only the regulating side may own a Regulator - constructing one
+  // zeroes the shared control value the other side is using
+  using Reg = decltype(makeRegulator(buffSize,tsq.control(),setpointSize1,0,k));
+  std::optional<Reg> reg;
+  if( regulate )
+    reg.emplace(buffSize,tsq.control(),setpointSize1,0,k);
+
+  StackProfiledThread regThread("regThread",[&](){
+			  while(!finFlag && regulate)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      buffSize = tsq.size();
+			      reg->update();
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&]()
+			    {
+			      int x = false;
+			      while(!finFlag && regulate)
+				{
+				  auto now = std::chrono::steady_clock::now();
+				  int size = (x = !x) ? setpointSize1 : setpointSize2;
+				  tsq.set_size_limit(size*2);
+				  reg->setpoint(size,0);
+				  std::this_thread::sleep_until(now+std::chrono::seconds(1));
+				}
+			    });
+  StackProfiledThread ioThread("ioThread",[&](){
+			  int x = 0;
+			  if( is_producer )
+			    x = cin.get();
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      int setpoint = setpointFlow + tsq.control().load();
+			      int success = 0;
+			      // flow per ms: producer pushes up to its setpoint,
+			      // consumer pops a fixed amount
+			      int todo = is_producer ? setpoint : setpointFlow;
+			      for(int i = 0; i < todo; ++i)
+				{
+				  if( is_producer )
+				    {
+				      if( !tsq.push(x) ) break;
+				      x = cin.get();
+				    }
+				  else
+				    {
+				      if( !tsq.wait_and_pop(x) ) break;
+				      cout<<char(x);
+				    }
+				  ++success;
+				}
+			      flow.fetch_add(success);
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+
+  auto start = std::chrono::steady_clock::now();
+  cerr<<"time buffSize control flow\n";
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      tsq.beat();
+      if( !tsq.peer_alive() )
+	{
+	  cerr<<"# peer died\n";
+	  break;
+	}
+      cerr<<time_c<<' '<<tsq.size()<<' '<<tsq.control()<<' '<<flow<<'\n';
+      flow = 0;
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  regThread.join(cerr);
+  chBufSetpoint.join(cerr);
+  ioThread.join(cerr);
+}
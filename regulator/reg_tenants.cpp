@@ -0,0 +1,144 @@
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string>
+
+#include <queue>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <random>
+
+#include "stack_profiler.h"
+#include "regulator.h"
+#include "fair_scheduler.h"
+
+// Many tenant queues drained by two consumers through FairScheduler.
+// Tenant 0 is hot and gets half of all produced elements. Every tenant has
+// its own Regulator: the further its queue is above the size setpoint, the
+// higher its scheduling weight, so no queue runs away while the hot one
+// cannot starve the rest.
+constexpr size_t tenants = 64;
+constexpr int setpointWeight = 4;
+constexpr int setpointSize1 = 1000;
+constexpr int setpointSize2 = 5000;
+
+std::atomic<bool> finFlag {false};
+threadsafe_queue<int> queues[tenants];
+std::atomic<int> sizes[tenants];
+std::atomic<int> weights[tenants];
+std::atomic<int> served[tenants];
+FairScheduler<threadsafe_queue<int>> scheduler(tenants);
+
+std::atomic<int> inFlow {0};
+std::atomic<int> outFlow {0};
+
+using namespace std;
+
+int main(int argc,const char* argv[])
+{
+  float k = (argc == 2)? std::stof(argv[1]) : -0.01f;
+  using Reg = decltype(makeRegulator(sizes[0],weights[0],setpointSize1,setpointWeight,k));
+  std::vector<Reg> regs;
+  for(size_t i = 0; i < tenants; ++i)
+    {
+      queues[i].set_size_limit(setpointSize2*2);
+      scheduler.attach(i,queues[i],setpointWeight);
+      regs.push_back(makeRegulator(sizes[i],weights[i],setpointSize1,setpointWeight,k));
+    }
+
+  StackProfiledThread regThread("regThread",[&regs](){
+			  while(!finFlag)
+			    {
+			      auto now = std::chrono::steady_clock::now();
+			      for(size_t i = 0; i < tenants; ++i)
+				{
+				  sizes[i] = queues[i].size();
+				  regs[i].update();
+				  scheduler.set_weight(i,std::max(1,weights[i].load()));
+				}
+			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
+			    }
+			});
+  StackProfiledThread insThread("insThread",[](){
+			  std::mt19937 gen(1);
+			  std::uniform_int_distribution<size_t> pick(0,2*tenants-3);
+			  int x = 0;
+			  while(!finFlag)
+			    {
+			      int success = 0;
+			      for(int i = 0; i < 100; ++i)
+				{
+				  size_t t = pick(gen);
+				  t = t < tenants-1 ? 0 : t-(tenants-2);
+				  if( queues[t].push(++x) )
+				    {
+				      scheduler.mark(t);
+				      ++success;
+				    }
+				}
+			      inFlow.fetch_add(success);
+			      std::this_thread::yield();
+			    }
+			});
+  auto consumer = [](){
+		    while(!finFlag)
+		      {
+			size_t success = scheduler.serve<int>([](size_t lane,int){
+								// stand-in for real per element work
+								for(volatile int w = 0; w < 2000; ++w);
+								served[lane].fetch_add(1,std::memory_order_relaxed);
+							      });
+			if( success )
+			  outFlow.fetch_add(success);
+			else
+			  std::this_thread::yield();
+		      }
+		  };
+  StackProfiledThread remThread1("remThread1",consumer);
+  StackProfiledThread remThread2("remThread2",consumer);
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&regs]()
+			    {
+			      int x = false;
+			      while(!finFlag)
+				{
+				  auto now = std::chrono::steady_clock::now();
+				  int size = (x = !x) ? setpointSize1 : setpointSize2;
+				  for(auto& reg : regs)
+				    reg.setpoint(size,setpointWeight);
+				  std::this_thread::sleep_until(now+std::chrono::seconds(1));
+				}
+			    });
+
+  auto start = std::chrono::steady_clock::now();
+  cerr<<"time hotSize otherSizeMax hotWeight inFlow outFlow\n";
+  for(unsigned int time_c = 0; time_c < 10000;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto time = std::chrono::duration_cast<std::chrono::milliseconds>(now-start);
+      time_c = time.count();
+      int other_max = 0;
+      for(size_t i = 1; i < tenants; ++i)
+	other_max = std::max(other_max,sizes[i].load());
+      cerr<<time_c<<' '<<sizes[0]<<' '<<other_max<<' '<<scheduler.weight(0)
+	  <<' '<<inFlow<<' '<<outFlow<<'\n';
+      inFlow = 0;
+      outFlow = 0;
+      std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+    }
+  finFlag = true;
+  regThread.join(cerr);
+  insThread.join(cerr);
+  remThread1.join(cerr);
+  remThread2.join(cerr);
+  chBufSetpoint.join(cerr);
+  int other_min = served[1], other_max = served[1];
+  for(size_t i = 1; i < tenants; ++i)
+    {
+      other_min = std::min(other_min,served[i].load());
+      other_max = std::max(other_max,served[i].load());
+    }
+  cerr<<"# served hot: "<<served[0]<<" others: "<<other_min<<".."<<other_max<<'\n';
+}
@@ -9,6 +9,8 @@
 #include <memory>
 #include <atomic>
 
+#include "stack_profiler.h"
+
 template<typename T>
 class threadsafe_queue
 {
@@ -116,7 +118,7 @@ int main(int argc,const char* argv[])
   float k = (argc == 2)? std::stof(argv[1]) : 0.0f;
   auto reg = makeRegulator(buffSize,diffFlow,setpointSize1,setpointFlow,k);
 
-  std::thread regThread([&reg](){
+  StackProfiledThread regThread("regThread",[&reg](){
 			  while(!finFlag)
 			    {
 			      auto now = std::chrono::steady_clock::now();
@@ -125,7 +127,7 @@ int main(int argc,const char* argv[])
 			      std::this_thread::sleep_until(now+std::chrono::milliseconds(1));
 			    }
 			});
-  std::thread insThread([](){
+  StackProfiledThread insThread("insThread",[](){
 			  int x=0;
 			  x = cin.get();
 			  while(!finFlag)
@@ -148,7 +150,7 @@ int main(int argc,const char* argv[])
 			      std::this_thread::yield();
 			    }
 			});
-  std::thread remThread([](){
+  StackProfiledThread remThread("remThread",[](){
   			  int x=0;
   			  while(!finFlag)
   			    {
@@ -162,7 +164,7 @@ int main(int argc,const char* argv[])
   			      outFlow.fetch_add(success);
   			    }
   			});
-  std::thread chBufSetpoint([&reg,k]()
+  StackProfiledThread chBufSetpoint("chBufSetpoint",[&reg,k]()
   			    {
   			      int x = false;
 				while(!finFlag)
@@ -195,8 +197,8 @@ int main(int argc,const char* argv[])
       std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
     }
   finFlag = true;
-  regThread.join();
-  insThread.join();
-  remThread.join();
-  chBufSetpoint.join();
+  regThread.join(cerr);
+  insThread.join(cerr);
+  remThread.join(cerr);
+  chBufSetpoint.join(cerr);
 }
@@ -0,0 +1,99 @@
+#ifndef REGULATOR_H
+#define REGULATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <queue>
+
+template<typename T>
+class threadsafe_queue
+{
+private:
+  mutable std::mutex mut;
+  std::queue<T> data_queue;
+  std::atomic<size_t> size_limit { 1000000 };
+public:
+  threadsafe_queue()
+  {}
+
+  bool push(T new_value)
+  {
+    std::lock_guard<std::mutex> lk(mut);
+    if ( m_full() )
+      return false;
+    data_queue.push(std::move(new_value));
+    return true;
+  }
+  bool wait_and_pop(T& value)
+  {
+    std::lock_guard<std::mutex> lk(mut);
+    if( m_empty() )
+      return false;
+    value=std::move(data_queue.front());
+    data_queue.pop();
+    return true;
+  }
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lk(mut);
+    return m_size();
+  }
+  void set_size_limit(size_t limit)
+  {
+    size_limit.store(limit);
+  }
+private:
+  size_t m_size() const
+  {
+    return data_queue.size();
+  }
+  bool m_full() const
+  {
+    return m_size() >= size_limit;
+  }
+  bool m_empty() const
+  {
+    return data_queue.empty();
+  }
+};
+
+// Proportional regulator: ctrl = ctrl0 - k*(reg - reg0) on every update().
+// Zeroes the controlled value when constructed.
+template <typename RegT,typename CtrlT,typename RegSPT,typename CtrlSPT>
+class Regulator
+{
+  const RegT& m_reg;
+  CtrlT& m_ctrl;
+  float m_k;
+  RegSPT m_reg0;
+  CtrlSPT m_ctrl0;
+public:
+  Regulator(RegT& reg,CtrlT& ctrl,RegSPT reg0, CtrlSPT ctrl0,float k)
+    : m_reg(reg),m_ctrl(ctrl),m_k(k),m_reg0(reg0),m_ctrl0(ctrl0)
+  {
+    m_ctrl = 0;
+  }
+  Regulator(const Regulator&) = default;
+  Regulator(Regulator&&) = default;
+  ~Regulator() = default;
+public:
+  void operator()(){ update(); }
+  void update()
+  {
+    m_ctrl = m_ctrl0 - static_cast<CtrlT>(m_k*(m_reg - m_reg0));
+  }
+  void setpoint(RegSPT reg0, CtrlSPT ctrl0)
+  {
+    m_reg0 = reg0;
+    m_ctrl0 = ctrl0;
+  }
+};
+
+template <typename RegT,typename CtrlT,typename RegSPT,typename CtrlSPT>
+Regulator<RegT,CtrlT,RegSPT,CtrlSPT> makeRegulator(RegT& reg,CtrlT& ctrl,RegSPT reg0, CtrlSPT ctrl0,float k)
+{
+  return Regulator<RegT,CtrlT,RegSPT,CtrlSPT>(reg,ctrl,reg0,ctrl0,k);
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef REGULATOR_BANK_H
+#define REGULATOR_BANK_H
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+
+// Many P regulators updated together. Gains, setpoints, measurements and
+// outputs are kept in separate arrays (structure of arrays), so one tick
+// is a single branch-free SIMD pass:
+//   ctrl[i] = ctrl0[i] - k[i]*(reg[i] - reg0[i])
+// the same law as Regulator::update.
+class RegulatorBank
+{
+  std::vector<float> m_k;
+  std::vector<float> m_reg0;
+  std::vector<float> m_ctrl0;
+  std::vector<float> m_reg;
+  std::vector<float> m_ctrl;
+  struct Setpoint { size_t i; float reg0; float ctrl0; };
+  std::mutex m_mut;
+  std::vector<Setpoint> m_requests;
+  std::atomic<bool> m_requested {false};
+public:
+  RegulatorBank() = default;
+  explicit RegulatorBank(size_t reserve)
+  {
+    m_k.reserve(reserve);
+    m_reg0.reserve(reserve);
+    m_ctrl0.reserve(reserve);
+    m_reg.reserve(reserve);
+    m_ctrl.reserve(reserve);
+  }
+  // Adds a loop, returns its index
+  size_t add(float k,float reg0,float ctrl0)
+  {
+    m_k.push_back(k);
+    m_reg0.push_back(reg0);
+    m_ctrl0.push_back(ctrl0);
+    m_reg.push_back(reg0);
+    m_ctrl.push_back(ctrl0);
+    return m_k.size()-1;
+  }
+  size_t size() const { return m_k.size(); }
+
+  void setpoint(size_t i,float reg0,float ctrl0)
+  {
+    m_reg0[i] = reg0;
+    m_ctrl0[i] = ctrl0;
+  }
+  void gain(size_t i,float k) { m_k[i] = k; }
+  // setpoint() from another thread - applied at the start of next update()
+  void request_setpoint(size_t i,float reg0,float ctrl0)
+  {
+    std::lock_guard<std::mutex> lk(m_mut);
+    m_requests.push_back({i,reg0,ctrl0});
+    m_requested.store(true,std::memory_order_release);
+  }
+
+  // Measurements are written here before update(), outputs read after it
+  float* measurements() { return m_reg.data(); }
+  const float* outputs() const { return m_ctrl.data(); }
+  float& measurement(size_t i) { return m_reg[i]; }
+  float output(size_t i) const { return m_ctrl[i]; }
+
+  void update()
+  {
+    if( m_requested.load(std::memory_order_acquire) )
+      {
+	std::lock_guard<std::mutex> lk(m_mut);
+	for(auto& r : m_requests)
+	  setpoint(r.i,r.reg0,r.ctrl0);
+	m_requests.clear();
+	m_requested.store(false,std::memory_order_relaxed);
+      }
+    update(m_ctrl.data(),m_k.data(),m_reg.data(),m_reg0.data(),m_ctrl0.data(),size());
+  }
+private:
+  // 4 loops per step in one vector register (SSE, NEON), the rest one by one
+  typedef float v4f __attribute__((vector_size(16)));
+  static v4f load(const float* p)
+  {
+    v4f v;
+    std::memcpy(&v,p,sizeof(v));
+    return v;
+  }
+  static void update(float* __restrict ctrl,const float* __restrict k,
+		     const float* __restrict reg,const float* __restrict reg0,
+		     const float* __restrict ctrl0,size_t n)
+  {
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+      {
+	v4f v = load(ctrl0+i) - load(k+i)*(load(reg+i) - load(reg0+i));
+	std::memcpy(ctrl+i,&v,sizeof(v));
+      }
+    for(; i < n; ++i)
+      ctrl[i] = ctrl0[i] - k[i]*(reg[i] - reg0[i]);
+  }
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+// Bounded single producer / single consumer ring in a shm_open region, for
+// a producer and a consumer in separate processes. The region holds only
+// indices (free running counters, position = counter % T_size), never
+// pointers, so it works wherever each process maps it. Both sides store
+// their pid and a heartbeat, so a dead or hung peer can be detected.
+// The size limit and a control value live in the region too, so the
+// Regulator can run in either process.
+template<typename T, size_t T_size = 32768>
+class shm_queue
+{
+  static_assert(std::is_trivially_copyable<T>::value,"Elements are copied between processes");
+  static_assert((T_size & (T_size-1)) == 0,"Ring size has to be a power of two");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,"Shared atomics have to be lock free");
+  static constexpr uint64_t magic = 0x73686d5f71756575; // "shm_queue"
+
+  struct Shared
+  {
+    std::atomic<uint64_t> ready;
+    uint64_t size;
+    alignas(64) std::atomic<uint64_t> push_count;
+    alignas(64) std::atomic<uint64_t> pop_count;
+    alignas(64) std::atomic<uint64_t> size_limit;
+    std::atomic<int> control;
+    std::atomic<int> pid[2];
+    std::atomic<int64_t> beat[2];
+    alignas(64) T space[T_size];
+  };
+public:
+  enum Role { producer = 0, consumer = 1 };
+
+  // producer creates the region (replacing a stale one left by a dead
+  // producer, failing with EBUSY if its producer is alive), consumer waits
+  // for it to appear and to get its full size - touching it before the
+  // producer's ftruncate would raise SIGBUS - and to be made ready
+  shm_queue(std::string name,Role role)
+    : m_name(std::move(name)),m_role(role)
+  {
+    if( role == producer )
+      {
+	if( live_producer() )
+	  throw std::system_error(EBUSY,std::generic_category(),m_name);
+	shm_unlink(m_name.c_str());
+	int fd = shm_open(m_name.c_str(),O_RDWR | O_CREAT | O_EXCL,0600);
+	if( fd < 0 )
+	  throw std::system_error(errno,std::generic_category(),m_name);
+	if( ftruncate(fd,sizeof(Shared)) != 0 )
+	  {
+	    int error = errno;
+	    close(fd);
+	    shm_unlink(m_name.c_str());
+	    throw std::system_error(error,std::generic_category(),m_name);
+	  }
+	m_shared = new (map(fd)) Shared;
+	m_shared->size = T_size;
+	m_shared->push_count = 0;
+	m_shared->pop_count = 0;
+	m_shared->size_limit = T_size;
+	m_shared->control = 0;
+	m_shared->pid[producer] = getpid();
+	m_shared->pid[consumer] = 0;
+	m_shared->beat[consumer] = 0;
+	m_shared->ready.store(magic,std::memory_order_release);
+      }
+    else
+      for(;;)
+	{
+	  m_shared = static_cast<Shared*>(map(open_sized()));
+	  if( wait_ready() )
+	    {
+	      if( m_shared->size == T_size )
+		break;
+	      munmap(m_shared,sizeof(Shared));
+	      throw std::system_error(EINVAL,std::generic_category(),m_name);
+	    }
+	  // stale region of a dead producer, reopen to find the new one
+	  munmap(m_shared,sizeof(Shared));
+	  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+    m_shared->pid[role] = getpid();
+    beat();
+  }
+  shm_queue(const shm_queue&) = delete;
+  shm_queue& operator=(const shm_queue&) = delete;
+  ~shm_queue()
+  {
+    m_shared->pid[m_role] = 0;
+    munmap(m_shared,sizeof(Shared));
+    if( m_role == producer )
+      shm_unlink(m_name.c_str());
+  }
+
+  bool push(T new_value)
+  {
+    uint64_t push = m_shared->push_count.load(std::memory_order_relaxed);
+    uint64_t pop = m_shared->pop_count.load(std::memory_order_acquire);
+    if( push - pop >= std::min<uint64_t>(m_shared->size_limit.load(std::memory_order_relaxed),T_size) )
+      return false;
+    m_shared->space[push % T_size] = new_value;
+    m_shared->push_count.store(push+1,std::memory_order_release);
+    return true;
+  }
+  bool wait_and_pop(T& value)
+  {
+    uint64_t pop = m_shared->pop_count.load(std::memory_order_relaxed);
+    if( pop == m_shared->push_count.load(std::memory_order_acquire) )
+      return false;
+    value = m_shared->space[pop % T_size];
+    m_shared->pop_count.store(pop+1,std::memory_order_release);
+    return true;
+  }
+  size_t size()
+  {
+    uint64_t pop = m_shared->pop_count.load(std::memory_order_acquire);
+    return m_shared->push_count.load(std::memory_order_acquire) - pop;
+  }
+  void set_size_limit(size_t limit)
+  {
+    m_shared->size_limit.store(limit);
+  }
+  // Shared value for the Regulator output, e.g. the flow correction
+  std::atomic<int>& control() { return m_shared->control; }
+
+  // Call periodically; the peer sees a stale heartbeat when this side hangs
+  void beat()
+  {
+    m_shared->beat[m_role].store(now_ms(),std::memory_order_relaxed);
+  }
+  // Peer process exists and has beaten within timeout
+  bool peer_alive(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000))
+  {
+    int peer = m_shared->pid[1-m_role].load();
+    if( peer == 0 )
+      return m_role == producer;	// consumer not attached yet
+    if( kill(peer,0) != 0 && errno == ESRCH )
+      return false;
+    return now_ms() - m_shared->beat[1-m_role].load(std::memory_order_relaxed) <= timeout.count();
+  }
+private:
+  static bool alive(int pid)
+  {
+    return pid > 0 && (kill(pid,0) == 0 || errno != ESRCH);
+  }
+  // Producer of an existing region under our name, if it is alive
+  bool live_producer() const
+  {
+    int fd = shm_open(m_name.c_str(),O_RDONLY,0600);
+    if( fd < 0 )
+      return false;
+    struct stat st;
+    bool sized = fstat(fd,&st) == 0 && size_t(st.st_size) == sizeof(Shared);
+    void* map = sized ? mmap(nullptr,sizeof(Shared),PROT_READ,MAP_SHARED,fd,0) : MAP_FAILED;
+    close(fd);
+    if( map == MAP_FAILED )
+      return false;
+    bool result = alive(static_cast<Shared*>(map)->pid[producer].load());
+    munmap(map,sizeof(Shared));
+    return result;
+  }
+  // Consumer: waits until the producer has made the region ready. False
+  // when the producer is dead or the region does not get ready within a
+  // second - it was left by a producer that died while creating it.
+  bool wait_ready() const
+  {
+    for(int i = 0; i < 1000; ++i)
+      {
+	if( m_shared->ready.load(std::memory_order_acquire) == magic )
+	  return alive(m_shared->pid[producer].load());
+	int pid = m_shared->pid[producer].load();
+	if( pid && !alive(pid) )
+	  return false;
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    return false;
+  }
+  // Opens the region once the producer has sized it. Reopens by name while
+  // waiting, a stale region may be replaced by a new one meanwhile.
+  int open_sized() const
+  {
+    for(;;)
+      {
+	int fd = shm_open(m_name.c_str(),O_RDWR,0600);
+	if( fd < 0 && errno != ENOENT )
+	  throw std::system_error(errno,std::generic_category(),m_name);
+	if( fd >= 0 )
+	  {
+	    struct stat st;
+	    if( fstat(fd,&st) != 0 )
+	      {
+		int error = errno;
+		close(fd);
+		throw std::system_error(error,std::generic_category(),m_name);
+	      }
+	    if( size_t(st.st_size) == sizeof(Shared) )
+	      return fd;
+	    close(fd);
+	  }
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+  }
+  // Maps and closes fd
+  void* map(int fd) const
+  {
+    void* result = mmap(nullptr,sizeof(Shared),PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    int error = errno;
+    close(fd);
+    if( result == MAP_FAILED )
+      {
+	if( m_role == producer )
+	  shm_unlink(m_name.c_str());
+	throw std::system_error(error,std::generic_category(),m_name);
+      }
+    return result;
+  }
+  static int64_t now_ms()
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  std::string m_name;
+  Role m_role;
+  Shared* m_shared;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef STACK_PROFILER_H
+#define STACK_PROFILER_H
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+// Thread with a stack of a chosen size, painted with a pattern before the
+// thread starts. At join the untouched part is measured from the bottom,
+// which gives the stack high-water mark of the thread: what STACK_KB has to
+// cover. Of that, overhead() is the part above the thread function's entry
+// - the TLS, thread control block and start frames glibc puts at the top
+// of the stack - and the rest is the thread function's own peak.
+// Default stack size comes from STACK_KB in the environment (64 kB if not set).
+class StackProfiledThread
+{
+  static constexpr unsigned char paint = 0xA5;
+  std::string m_name;
+  std::function<void()> m_fn;
+  size_t m_size;
+  size_t m_guard;
+  unsigned char* m_map = nullptr;
+  unsigned char* m_entry = nullptr;	// stack pointer at entry of run()
+  pthread_t m_thread;
+  bool m_joinable = false;
+public:
+  template <typename F>
+  StackProfiledThread(std::string name,size_t stack_size,F fn)
+    : m_name(std::move(name)),m_fn(std::move(fn)),m_guard(sysconf(_SC_PAGESIZE))
+  {
+    m_size = (std::max<size_t>(stack_size,PTHREAD_STACK_MIN) + m_guard - 1) / m_guard * m_guard;
+    void* map = mmap(nullptr,m_size + m_guard,PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,-1,0);
+    if( map == MAP_FAILED )
+      throw std::system_error(errno,std::generic_category(),m_name);
+    m_map = static_cast<unsigned char*>(map);
+    // guard page below the stack - overflow faults instead of corrupting
+    if( mprotect(m_map,m_guard,PROT_NONE) )
+      {
+	int error = errno;
+	munmap(m_map,m_size + m_guard);
+	throw std::system_error(error,std::generic_category(),m_name);
+      }
+    std::memset(stack(),paint,m_size);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    int error = pthread_attr_setstack(&attr,stack(),m_size);
+    // without our stack the thread would run on a default one, unmeasured
+    if( !error )
+      error = pthread_create(&m_thread,&attr,&StackProfiledThread::run,this);
+    pthread_attr_destroy(&attr);
+    if( error )
+      {
+	munmap(m_map,m_size + m_guard);
+	throw std::system_error(error,std::generic_category(),m_name);
+      }
+    m_joinable = true;
+  }
+  template <typename F>
+  StackProfiledThread(std::string name,F fn)
+    : StackProfiledThread(std::move(name),default_size(),std::move(fn))
+  {}
+  StackProfiledThread(const StackProfiledThread&) = delete;
+  StackProfiledThread& operator=(const StackProfiledThread&) = delete;
+  ~StackProfiledThread()
+  {
+    if( m_joinable )
+      std::terminate();
+    if( m_map )
+      munmap(m_map,m_size + m_guard);
+  }
+
+  // Joins the thread and returns its peak stack usage in bytes
+  size_t join()
+  {
+    pthread_join(m_thread,nullptr);
+    m_joinable = false;
+    size_t untouched = 0;
+    while( untouched < m_size && stack()[untouched] == paint )
+      ++untouched;
+    return m_size - untouched;
+  }
+  // Joins and reports the peak as a comment line of the plotted output
+  size_t join(std::ostream& out)
+  {
+    size_t used = join();
+    out<<"# stack "<<m_name<<": "<<used<<" of "<<m_size<<" bytes ("
+       <<overhead()<<" thread overhead)\n";
+    return used;
+  }
+  size_t size() const { return m_size; }
+  // Bytes above the thread function's entry, used before it runs
+  size_t overhead() const { return stack() + m_size - m_entry; }
+
+  static size_t default_size()
+  {
+    const char* kb = std::getenv("STACK_KB");
+    return kb ? std::strtoul(kb,nullptr,10)*1024 : 64*1024;
+  }
+private:
+  unsigned char* stack() const { return m_map + m_guard; }
+  static void* run(void* self)
+  {
+    auto thread = static_cast<StackProfiledThread*>(self);
+    thread->m_entry = static_cast<unsigned char*>(__builtin_frame_address(0));
+    thread->m_fn();
+    return nullptr;
+  }
+};
+
+#endif
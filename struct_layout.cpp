@@ -0,0 +1,237 @@
+#include <iostream>
+#include <iomanip>
+#include <array>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "regulator/regulator.h"
+using namespace std;
+
+// Field layout of an aggregate, computed at compile time from its field
+// types in declaration order - the same rules the compiler uses: every
+// field starts at the next multiple of its alignment, the struct is
+// rounded up to its strictest alignment.
+//
+// Fields are plain types or named: FIELD_NAME(count); Field<count,int>.
+// References are laid out as pointers.
+
+#define FIELD_NAME(N) struct N { static constexpr const char* name = #N; }
+
+template <typename Name,typename T>
+struct Field { using name = Name; using type = T; };
+
+template <typename F>
+struct FieldTraits
+{
+    using name = void;
+    using type = F;
+};
+template <typename Name,typename T>
+struct FieldTraits<Field<Name,T>>
+{
+    using name = Name;
+    using type = T;
+};
+
+template <typename F>
+using field_type = typename FieldTraits<F>::type;
+template <typename F>
+using field_storage = conditional_t<is_reference<field_type<F>>::value,
+				    remove_reference_t<field_type<F>>*,field_type<F>>;
+
+constexpr size_t align_up(size_t offset,size_t align)
+{ return (offset + align - 1) / align * align; }
+
+template <typename... Fs>
+struct Layout
+{
+    static constexpr size_t count = sizeof...(Fs);
+    static constexpr array<size_t,count> sizes {sizeof(field_storage<Fs>)...};
+    static constexpr array<size_t,count> aligns {alignof(field_storage<Fs>)...};
+    static constexpr size_t align = max({size_t(1),alignof(field_storage<Fs>)...});
+    static constexpr array<size_t,count> offsets = []{
+	array<size_t,count> result {};
+	size_t offset = 0;
+	for(size_t i = 0; i < count; ++i)
+	    {
+		result[i] = align_up(offset,aligns[i]);
+		offset = result[i] + sizes[i];
+	    }
+	return result;
+    }();
+    static constexpr size_t size = count ? align_up(offsets[count-1] + sizes[count-1],align) : 1;
+    static constexpr size_t payload = (size_t(0) + ... + sizeof(field_storage<Fs>));
+    static constexpr size_t padding = size - payload;
+    // Smallest size reachable by reordering: fields sorted by alignment
+    static constexpr size_t ideal_size = []{
+	array<size_t,count> order {};
+	for(size_t i = 0; i < count; ++i)
+	    order[i] = i;
+	for(size_t i = 1; i < count; ++i)
+	    for(size_t j = i; j > 0 && aligns[order[j]] > aligns[order[j-1]]; --j)
+		{
+		    size_t tmp = order[j];
+		    order[j] = order[j-1];
+		    order[j-1] = tmp;
+		}
+	size_t offset = 0;
+	for(size_t i = 0; i < count; ++i)
+	    offset = align_up(offset,aligns[order[i]]) + sizes[order[i]];
+	return count ? align_up(offset,align) : 1;
+    }();
+
+    static void report(const char* name,ostream& out = cout)
+    {
+	const char* names[] = {field_name<Fs>()...,""};
+	out<<name<<": size "<<size<<", payload "<<payload<<", padding "<<padding
+	   <<", ideal size "<<ideal_size<<endl;
+	for(size_t i = 0; i < count; ++i)
+	    {
+		size_t end = i+1 < count ? offsets[i+1] : size;
+		out<<"  "<<setw(4)<<offsets[i]<<" "<<setw(12)<<left<<names[i]<<right
+		   <<" size "<<sizes[i];
+		if( end > offsets[i] + sizes[i] )
+		    out<<" + "<<end - offsets[i] - sizes[i]<<" padding";
+		out<<endl;
+	    }
+    }
+private:
+    template <typename F>
+    static const char* field_name()
+    {
+	if constexpr (is_void<typename FieldTraits<F>::name>::value)
+	    return "?";
+	else
+	    return FieldTraits<F>::name::name;
+    }
+};
+
+// Storage with fields sorted by alignment - strictest first - accessed by
+// name: Packed<Field<a,char>,Field<b,double>> p; get<b>(p) = 1.0;
+template <typename... Fs>
+struct FieldList {};
+
+template <typename F,typename List>
+struct FieldInsert;
+template <typename F>
+struct FieldInsert<F,FieldList<>> { using type = FieldList<F>; };
+template <typename F,typename U,typename... Us>
+struct FieldInsert<F,FieldList<U,Us...>>
+{
+    template <typename... Vs>
+    static FieldList<U,Vs...> prepend(FieldList<Vs...>);
+    template <bool first,typename = void>
+    struct pick { using type = FieldList<F,U,Us...>; };
+    template <typename Dummy>
+    struct pick<false,Dummy>
+    { using type = decltype(prepend(typename FieldInsert<F,FieldList<Us...>>::type{})); };
+    using type = typename pick<(alignof(field_type<F>) >= alignof(field_type<U>))>::type;
+};
+
+template <typename... Fs>
+struct FieldSort { using type = FieldList<>; };
+template <typename F,typename... Fs>
+struct FieldSort<F,Fs...>
+{ using type = typename FieldInsert<F,typename FieldSort<Fs...>::type>::type; };
+
+template <typename List>
+struct PackedStorage;
+template <>
+struct PackedStorage<FieldList<>> {};
+template <typename F>
+struct PackedStorage<FieldList<F>>
+{
+    static_assert(!is_reference<field_type<F>>::value,"Packed fields have to be values");
+    field_type<F> value {};
+
+    template <typename Name>
+    auto& get()
+    {
+	static_assert(is_same<Name,typename F::name>::value,"No such field");
+	return value;
+    }
+};
+template <typename F,typename F2,typename... Fs>
+struct PackedStorage<FieldList<F,F2,Fs...>>
+{
+    static_assert(!is_reference<field_type<F>>::value,"Packed fields have to be values");
+    field_type<F> value {};
+    PackedStorage<FieldList<F2,Fs...>> rest;
+
+    template <typename Name>
+    auto& get()
+    {
+	if constexpr (is_same<Name,typename F::name>::value)
+	    return value;
+	else
+	    return rest.template get<Name>();
+    }
+};
+
+template <typename... Fs>
+struct Packed : PackedStorage<typename FieldSort<Fs...>::type>
+{
+    using Declared = Layout<Fs...>;
+};
+
+template <typename Name,typename... Fs>
+auto& get(Packed<Fs...>& p){ return p.template get<Name>(); }
+
+// Hot structs of this repo, fields as declared
+FIELD_NAME(m_reg);
+FIELD_NAME(m_ctrl);
+FIELD_NAME(m_k);
+FIELD_NAME(m_reg0);
+FIELD_NAME(m_ctrl0);
+// regulator/regulator.h: Regulator<atomic<int>,atomic<int>,int,int>
+using RegulatorLayout = Layout<Field<m_reg,const atomic<int>&>,Field<m_ctrl,atomic<int>&>,
+			       Field<m_k,float>,Field<m_reg0,int>,Field<m_ctrl0,int>>;
+static_assert(RegulatorLayout::size == sizeof(Regulator<atomic<int>,atomic<int>,int,int>),
+	      "RegulatorLayout differs from regulator/regulator.h");
+
+FIELD_NAME(mut);
+FIELD_NAME(cv_mut);
+FIELD_NAME(data_queue);
+FIELD_NAME(size_limit);
+FIELD_NAME(size_low);
+FIELD_NAME(size_high);
+FIELD_NAME(cv);
+FIELD_NAME(fin);
+// regulator/regulator.h: threadsafe_queue<int>
+using QueueLayout = Layout<Field<mut,mutex>,Field<data_queue,queue<int>>,
+			   Field<size_limit,atomic<size_t>>>;
+static_assert(QueueLayout::size == sizeof(threadsafe_queue<int>),
+	      "QueueLayout differs from regulator/regulator.h");
+// regulator/reg_conditional.cpp: threadsafe_queue<int>
+using CondQueueLayout = Layout<Field<mut,mutex>,Field<cv_mut,mutex>,Field<data_queue,queue<int>>,
+			       Field<size_limit,atomic<size_t>>,Field<size_low,atomic<size_t>>,
+			       Field<size_high,atomic<size_t>>,Field<cv,condition_variable>,
+			       Field<fin,atomic<bool>&>>;
+
+// stack_fragment.cpp locals as one struct
+FIELD_NAME(i1); FIELD_NAME(c1); FIELD_NAME(d1); FIELD_NAME(c2); FIELD_NAME(i2);
+FIELD_NAME(c3); FIELD_NAME(i3); FIELD_NAME(c4); FIELD_NAME(i5);
+using Fragment = Packed<Field<i1,int>,Field<c1,char>,Field<d1,double>,Field<c2,char>,
+			Field<i2,int>,Field<c3,char>,Field<i3,int>,Field<c4,char>,Field<i5,int>>;
+
+struct FragmentStruct { int i1; char c1; double d1; char c2; int i2; char c3; int i3; char c4; int i5; };
+static_assert(Fragment::Declared::size == sizeof(FragmentStruct),"Layout differs from the compiler");
+static_assert(sizeof(Fragment) == Fragment::Declared::ideal_size,"Packed is not minimal");
+
+int main()
+{
+    RegulatorLayout::report("Regulator");
+    QueueLayout::report("threadsafe_queue (regulator.h)");
+    CondQueueLayout::report("threadsafe_queue (reg_conditional.cpp)");
+    Fragment::Declared::report("stack_fragment locals");
+
+    Fragment f;
+    get<d1>(f) = 2.5;
+    get<c4>(f) = 'x';
+    cout<<"Packed stack_fragment locals: size "<<sizeof(Fragment)
+	<<", d1 "<<get<d1>(f)<<", c4 "<<get<c4>(f)<<endl;
+}